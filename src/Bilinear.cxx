@@ -14,6 +14,18 @@
 
 #include "st_facilities/Bilinear.h"
 
+#include "BilinearSimd.h"
+
+// The scalar arithmetic must match the vector kernels in
+// BilinearSimd.cxx exactly, so it must not be contracted into fused
+// multiply-adds either (-ffp-contract=off is also set for both files
+// in CMakeLists.txt).
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
 namespace {
    class Array {
    public:
@@ -26,6 +38,15 @@ namespace {
       const std::vector<double> & m_values;
       size_t m_nx;
    };
+   void setAxis(const std::vector<double> & xx,
+                const st_facilities::BinLocator & locator,
+                st_facilities::BilinearSimd::Axis & axis) {
+      axis.grid = &xx[0];
+      axis.n = xx.size();
+// The kernels only compute linearly spaced indices arithmetically.
+      axis.uniform = locator.isUniform() && !locator.isLogUniform();
+      locator.getSpacing(axis.first, axis.nsteps, axis.origin, axis.invStep);
+   }
 }
 
 namespace st_facilities {
@@ -62,15 +83,49 @@ Bilinear::Bilinear(const std::vector<double> & x,
       m_values.push_back(array(y.size()-1, i));
    }
    m_values.push_back(array(y.size()-1, x.size()-1));
+
+   m_xlocator = BinLocator(m_x);
+   m_ylocator = BinLocator(m_y);
 }
 
 double Bilinear::operator()(double x, double y) const {
-   double tt, uu;
-   std::vector<double> xvals(4);
-   std::vector<double> yvals(4);
-   std::vector<double> zvals(4);
-   getCorners(x, y, tt, uu, &xvals[0], &yvals[0], &zvals[0]);
-   return evaluate(tt, uu, &zvals[0]);
+   return value(x, y);
+}
+
+void Bilinear::evaluate(const double * x, const double * y, double * out,
+                        size_t n) const {
+// Select the vectorized kernel for this CPU once.  It handles whole
+// blocks of points; the remainder, and any block with a point that is
+// out-of-range, is done by the scalar code.
+   static const BilinearSimd::Kernel kernel(BilinearSimd::kernel());
+   size_t k(0);
+   if (kernel) {
+      BilinearSimd::Grid grid;
+      setAxis(m_x, m_xlocator, grid.x);
+      setAxis(m_y, m_ylocator, grid.y);
+      grid.z = &m_values[0];
+      k = kernel(grid, x, y, out, n);
+   }
+   for ( ; k < n; k++) {
+      out[k] = value(x[k], y[k]);
+   }
+}
+
+double Bilinear::value(double x, double y) const {
+   size_t i, j;
+   getIndices(x, y, i, j);
+
+   double tt((x - m_x[i-1])/(m_x[i] - m_x[i-1]));
+   double uu((y - m_y[j-1])/(m_y[j] - m_y[j-1]));
+
+   size_t xsize(m_x.size());
+   double zvals[4];
+   zvals[0] = m_values[xsize*(j-1) + (i-1)];
+   zvals[1] = m_values[xsize*(j-1) + (i)];
+   zvals[2] = m_values[xsize*(j) + (i)];
+   zvals[3] = m_values[xsize*(j) + (i-1)];
+
+   return evaluate(tt, uu, zvals);
 }
 
 double Bilinear::evaluate(double tt, double uu, 
@@ -82,34 +137,36 @@ double Bilinear::evaluate(double tt, double uu,
    return value;
 }
 
-void Bilinear::getCorners(double x, double y, 
-                          double & tt, double & uu,
-                          double * corner_xvals,
-                          double * corner_yvals,
-                          double * zvals) const {
-   typedef std::vector<double>::const_iterator const_iterator_t;
-
-   const_iterator_t ix(std::upper_bound(m_x.begin(), m_x.end(), x));
-   if (ix == m_x.end() && x != m_x.back()) {
+void Bilinear::getIndices(double x, double y, 
+                          size_t & i, size_t & j) const {
+   i = m_xlocator.upperBound(x);
+   if (i == m_x.size() && x != m_x.back()) {
       throw std::invalid_argument("Bilinear::operator: x out of range");
    }
    if (x == m_x.back()) {
-      ix = m_x.end() - 1;
+      i = m_x.size() - 1;
    } else if (x <= m_x.front()) {
-      ix = m_x.begin() + 1;
+      i = 1;
    }
-   int i(ix - m_x.begin());
     
-   const_iterator_t iy(std::upper_bound(m_y.begin(), m_y.end(), y));
-   if (iy == m_y.end() && y != m_y.back()) {
+   j = m_ylocator.upperBound(y);
+   if (j == m_y.size() && y != m_y.back()) {
       throw std::invalid_argument("Bilinear::operator: y out of range");
    }
    if (y == m_y.back()) {
-      iy = m_y.end() - 1;
+      j = m_y.size() - 1;
    } else if (y <= m_y.front()) {
-      iy = m_y.begin() + 1;
+      j = 1;
    }
-   int j(iy - m_y.begin());
+}
+
+void Bilinear::getCorners(double x, double y, 
+                          double & tt, double & uu,
+                          double * corner_xvals,
+                          double * corner_yvals,
+                          double * zvals) const {
+   size_t i, j;
+   getIndices(x, y, i, j);
 
    tt = (x - m_x[i-1])/(m_x[i] - m_x[i-1]);
    uu = (y - m_y[j-1])/(m_y[j] - m_y[j-1]);
@@ -0,0 +1,352 @@
+/**
+ * @file BilinearSimd.cxx
+ * @brief SSE2, AVX2 and AVX-512 batch kernels for Bilinear with
+ * runtime selection of the instruction set.
+ *
+ * Each kernel reproduces the scalar arithmetic of Bilinear::value
+ * operation by operation (no fused multiply-adds), so results are
+ * bit-identical to the scalar code.  For uniformly spaced axes the
+ * bracketing index is computed arithmetically and corrected by at most
+ * one node; otherwise the lanes run a branchless binary search in
+ * lockstep, since they all search the same array.
+ *
+ * $Header$
+ */
+
+#include <algorithm>
+
+#include "BilinearSimd.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ST_FACILITIES_X86_KERNELS
+#include <immintrin.h>
+// GCC treats the AVX-512 arithmetic intrinsics as ordinary operators
+// and would otherwise contract them into fused multiply-adds.
+#if !defined(__clang__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+#endif
+
+namespace {
+
+using st_facilities::BilinearSimd::Axis;
+using st_facilities::BilinearSimd::Grid;
+
+#ifdef ST_FACILITIES_X86_KERNELS
+
+/// Scalar equivalent of the vectorized bracketing below.  This
+/// returns the upper index of the grid cell containing v, applying
+/// the same edge rules as Bilinear::getIndices, or zero if v is out
+/// of range.
+inline size_t upperIndex(const Axis & axis, double v) {
+   const double * grid(axis.grid);
+   size_t n(axis.n);
+   if (!(v <= grid[n-1])) {
+      return 0;
+   }
+   if (v == grid[n-1]) {
+      return n - 1;
+   }
+   if (v <= grid[0]) {
+      return 1;
+   }
+   if (axis.uniform) {
+      double tt((v - axis.origin)*axis.invStep);
+      size_t indx(axis.first);
+      if (tt >= axis.nsteps) {
+         indx += axis.nsteps + 1;
+      } else if (tt >= 0) {
+         indx += static_cast<size_t>(tt) + 1;
+      }
+      indx = std::min(std::max(indx, size_t(1)), n - 1);
+      if (grid[indx] <= v) {
+         indx++;
+      } else if (grid[indx-1] > v) {
+         indx--;
+      }
+      return indx;
+   }
+   const double * base(grid);
+   for (size_t len(n); len > 1; ) {
+      size_t half(len/2);
+      base = (base[half] <= v) ? base + half : base;
+      len -= half;
+   }
+   return (base - grid) + (*base <= v);
+}
+
+size_t evaluate_sse2(const Grid & grid, const double * x, const double * y,
+                     double * out, size_t n) {
+   const __m128d one(_mm_set1_pd(1.));
+   size_t k(0);
+   for ( ; k + 2 <= n; k += 2) {
+      size_t i0(upperIndex(grid.x, x[k]));
+      size_t i1(upperIndex(grid.x, x[k+1]));
+      size_t j0(upperIndex(grid.y, y[k]));
+      size_t j1(upperIndex(grid.y, y[k+1]));
+      if (i0 == 0 || i1 == 0 || j0 == 0 || j1 == 0) {
+         break;
+      }
+      __m128d xv(_mm_loadu_pd(x + k));
+      __m128d yv(_mm_loadu_pd(y + k));
+      const double * gx(grid.x.grid);
+      const double * gy(grid.y.grid);
+      __m128d xlo(_mm_set_pd(gx[i1-1], gx[i0-1]));
+      __m128d xhi(_mm_set_pd(gx[i1], gx[i0]));
+      __m128d ylo(_mm_set_pd(gy[j1-1], gy[j0-1]));
+      __m128d yhi(_mm_set_pd(gy[j1], gy[j0]));
+      __m128d tt(_mm_div_pd(_mm_sub_pd(xv, xlo), _mm_sub_pd(xhi, xlo)));
+      __m128d uu(_mm_div_pd(_mm_sub_pd(yv, ylo), _mm_sub_pd(yhi, ylo)));
+
+      size_t nx(grid.x.n);
+      const double * r0(grid.z + nx*(j0-1) + (i0-1));
+      const double * r1(grid.z + nx*(j1-1) + (i1-1));
+      __m128d z0(_mm_set_pd(r1[0], r0[0]));
+      __m128d z1(_mm_set_pd(r1[1], r0[1]));
+      __m128d z2(_mm_set_pd(r1[nx+1], r0[nx+1]));
+      __m128d z3(_mm_set_pd(r1[nx], r0[nx]));
+
+      __m128d omt(_mm_sub_pd(one, tt));
+      __m128d omu(_mm_sub_pd(one, uu));
+      __m128d value(_mm_mul_pd(_mm_mul_pd(omt, omu), z0));
+      value = _mm_add_pd(value, _mm_mul_pd(_mm_mul_pd(tt, omu), z1));
+      value = _mm_add_pd(value, _mm_mul_pd(_mm_mul_pd(tt, uu), z2));
+      value = _mm_add_pd(value, _mm_mul_pd(_mm_mul_pd(omt, uu), z3));
+      _mm_storeu_pd(out + k, value);
+   }
+   return k;
+}
+
+__attribute__((target("avx2")))
+inline __m256d gather_avx2(const double * base, __m256i index) {
+   return _mm256_i64gather_pd(base, index, 8);
+}
+
+__attribute__((target("avx2")))
+inline __m256i select_avx2(__m256i a, __m256i b, __m256d mask) {
+   return _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(a),
+                                               _mm256_castsi256_pd(b),
+                                               mask));
+}
+
+__attribute__((target("avx2")))
+bool bracket_avx2(const Axis & axis, __m256d v, __m256i & index) {
+   const double * grid(axis.grid);
+   size_t n(axis.n);
+   __m256d front(_mm256_set1_pd(grid[0]));
+   __m256d back(_mm256_set1_pd(grid[n-1]));
+   if (_mm256_movemask_pd(_mm256_cmp_pd(v, back, _CMP_LE_OQ)) != 0xF) {
+      return false;
+   }
+   if (axis.uniform) {
+// Clamping to [-0.5, nsteps + 0.5] before taking the floor reproduces
+// the end cases of the scalar guess.
+      __m256d tt(_mm256_mul_pd(_mm256_sub_pd(v, _mm256_set1_pd(axis.origin)),
+                               _mm256_set1_pd(axis.invStep)));
+      tt = _mm256_max_pd(tt, _mm256_set1_pd(-0.5));
+      tt = _mm256_min_pd(tt, _mm256_set1_pd(axis.nsteps + 0.5));
+      __m256i offset(_mm256_cvtepi32_epi64(_mm256_cvttpd_epi32(
+                                              _mm256_floor_pd(tt))));
+      index = _mm256_add_epi64(offset, _mm256_set1_epi64x(axis.first + 1));
+      __m256i lo(_mm256_set1_epi64x(1));
+      __m256i hi(_mm256_set1_epi64x(n - 1));
+      index = _mm256_blendv_epi8(index, lo, _mm256_cmpgt_epi64(lo, index));
+      index = _mm256_blendv_epi8(index, hi, _mm256_cmpgt_epi64(index, hi));
+// Correct by one node; the comparison masks are -1 where true.
+      __m256d up(_mm256_cmp_pd(gather_avx2(grid, index), v, _CMP_LE_OQ));
+      __m256i below(_mm256_sub_epi64(index, _mm256_set1_epi64x(1)));
+      __m256d down(_mm256_andnot_pd(up, _mm256_cmp_pd(gather_avx2(grid, below),
+                                                      v, _CMP_GT_OQ)));
+      index = _mm256_sub_epi64(index, _mm256_castpd_si256(up));
+      index = _mm256_add_epi64(index, _mm256_castpd_si256(down));
+   } else {
+      __m256i base(_mm256_setzero_si256());
+      for (size_t len(n); len > 1; ) {
+         size_t half(len/2);
+         __m256i probe(_mm256_add_epi64(base, _mm256_set1_epi64x(half)));
+         __m256d le(_mm256_cmp_pd(gather_avx2(grid, probe), v, _CMP_LE_OQ));
+         base = select_avx2(base, probe, le);
+         len -= half;
+      }
+// The comparison mask is all ones, i.e., -1, in lanes to be incremented.
+      __m256d le(_mm256_cmp_pd(gather_avx2(grid, base), v, _CMP_LE_OQ));
+      index = _mm256_sub_epi64(base, _mm256_castpd_si256(le));
+   }
+   index = select_avx2(index, _mm256_set1_epi64x(1),
+                       _mm256_cmp_pd(v, front, _CMP_LE_OQ));
+   index = select_avx2(index, _mm256_set1_epi64x(n - 1),
+                       _mm256_cmp_pd(v, back, _CMP_EQ_OQ));
+   return true;
+}
+
+__attribute__((target("avx2")))
+size_t evaluate_avx2(const Grid & grid, const double * x, const double * y,
+                     double * out, size_t n) {
+   const __m256d one(_mm256_set1_pd(1.));
+   const __m256i ione(_mm256_set1_epi64x(1));
+   const __m256i nx(_mm256_set1_epi64x(grid.x.n));
+   size_t k(0);
+   for ( ; k + 4 <= n; k += 4) {
+      __m256d xv(_mm256_loadu_pd(x + k));
+      __m256d yv(_mm256_loadu_pd(y + k));
+      __m256i i, j;
+      if (!bracket_avx2(grid.x, xv, i) || !bracket_avx2(grid.y, yv, j)) {
+         break;
+      }
+      __m256i im1(_mm256_sub_epi64(i, ione));
+      __m256i jm1(_mm256_sub_epi64(j, ione));
+      __m256d xlo(gather_avx2(grid.x.grid, im1));
+      __m256d xhi(gather_avx2(grid.x.grid, i));
+      __m256d ylo(gather_avx2(grid.y.grid, jm1));
+      __m256d yhi(gather_avx2(grid.y.grid, j));
+      __m256d tt(_mm256_div_pd(_mm256_sub_pd(xv, xlo),
+                               _mm256_sub_pd(xhi, xlo)));
+      __m256d uu(_mm256_div_pd(_mm256_sub_pd(yv, ylo),
+                               _mm256_sub_pd(yhi, ylo)));
+
+// Grid indices are far below 2^32, so a 32x32->64 bit product suffices.
+      __m256i idx(_mm256_add_epi64(_mm256_mul_epu32(jm1, nx), im1));
+      __m256i idx_up(_mm256_add_epi64(idx, nx));
+      __m256d z0(gather_avx2(grid.z, idx));
+      __m256d z1(gather_avx2(grid.z, _mm256_add_epi64(idx, ione)));
+      __m256d z2(gather_avx2(grid.z, _mm256_add_epi64(idx_up, ione)));
+      __m256d z3(gather_avx2(grid.z, idx_up));
+
+      __m256d omt(_mm256_sub_pd(one, tt));
+      __m256d omu(_mm256_sub_pd(one, uu));
+      __m256d value(_mm256_mul_pd(_mm256_mul_pd(omt, omu), z0));
+      value = _mm256_add_pd(value, _mm256_mul_pd(_mm256_mul_pd(tt, omu), z1));
+      value = _mm256_add_pd(value, _mm256_mul_pd(_mm256_mul_pd(tt, uu), z2));
+      value = _mm256_add_pd(value, _mm256_mul_pd(_mm256_mul_pd(omt, uu), z3));
+      _mm256_storeu_pd(out + k, value);
+   }
+   return k;
+}
+
+__attribute__((target("avx512f")))
+inline __m512d gather_avx512(const double * base, __m512i index) {
+   return _mm512_i64gather_pd(index, base, 8);
+}
+
+__attribute__((target("avx512f")))
+bool bracket_avx512(const Axis & axis, __m512d v, __m512i & index) {
+   const double * grid(axis.grid);
+   size_t n(axis.n);
+   __m512d front(_mm512_set1_pd(grid[0]));
+   __m512d back(_mm512_set1_pd(grid[n-1]));
+   if (_mm512_cmp_pd_mask(v, back, _CMP_LE_OQ) != 0xFF) {
+      return false;
+   }
+   __m512i ione(_mm512_set1_epi64(1));
+   if (axis.uniform) {
+      __m512d tt(_mm512_mul_pd(_mm512_sub_pd(v, _mm512_set1_pd(axis.origin)),
+                               _mm512_set1_pd(axis.invStep)));
+      tt = _mm512_max_pd(tt, _mm512_set1_pd(-0.5));
+      tt = _mm512_min_pd(tt, _mm512_set1_pd(axis.nsteps + 0.5));
+      tt = _mm512_roundscale_pd(tt, _MM_FROUND_TO_NEG_INF);
+      __m512i offset(_mm512_cvtepi32_epi64(_mm512_cvttpd_epi32(tt)));
+      index = _mm512_add_epi64(offset, _mm512_set1_epi64(axis.first + 1));
+      index = _mm512_max_epi64(index, ione);
+      index = _mm512_min_epi64(index, _mm512_set1_epi64(n - 1));
+      __mmask8 up(_mm512_cmp_pd_mask(gather_avx512(grid, index), v,
+                                     _CMP_LE_OQ));
+      __m512i below(_mm512_sub_epi64(index, ione));
+      __mmask8 down(_mm512_cmp_pd_mask(gather_avx512(grid, below), v,
+                                       _CMP_GT_OQ) & ~up);
+      index = _mm512_mask_add_epi64(index, up, index, ione);
+      index = _mm512_mask_sub_epi64(index, down, index, ione);
+   } else {
+      __m512i base(_mm512_setzero_si512());
+      for (size_t len(n); len > 1; ) {
+         size_t half(len/2);
+         __m512i probe(_mm512_add_epi64(base, _mm512_set1_epi64(half)));
+         __mmask8 le(_mm512_cmp_pd_mask(gather_avx512(grid, probe), v,
+                                        _CMP_LE_OQ));
+         base = _mm512_mask_blend_epi64(le, base, probe);
+         len -= half;
+      }
+      __mmask8 le(_mm512_cmp_pd_mask(gather_avx512(grid, base), v,
+                                     _CMP_LE_OQ));
+      index = _mm512_mask_add_epi64(base, le, base, ione);
+   }
+   index = _mm512_mask_blend_epi64(_mm512_cmp_pd_mask(v, front, _CMP_LE_OQ),
+                                   index, ione);
+   index = _mm512_mask_blend_epi64(_mm512_cmp_pd_mask(v, back, _CMP_EQ_OQ),
+                                   index, _mm512_set1_epi64(n - 1));
+   return true;
+}
+
+__attribute__((target("avx512f")))
+size_t evaluate_avx512(const Grid & grid, const double * x, const double * y,
+                       double * out, size_t n) {
+   const __m512d one(_mm512_set1_pd(1.));
+   const __m512i ione(_mm512_set1_epi64(1));
+   const __m512i nx(_mm512_set1_epi64(grid.x.n));
+   size_t k(0);
+   for ( ; k + 8 <= n; k += 8) {
+      __m512d xv(_mm512_loadu_pd(x + k));
+      __m512d yv(_mm512_loadu_pd(y + k));
+      __m512i i, j;
+      if (!bracket_avx512(grid.x, xv, i) || !bracket_avx512(grid.y, yv, j)) {
+         break;
+      }
+      __m512i im1(_mm512_sub_epi64(i, ione));
+      __m512i jm1(_mm512_sub_epi64(j, ione));
+      __m512d xlo(gather_avx512(grid.x.grid, im1));
+      __m512d xhi(gather_avx512(grid.x.grid, i));
+      __m512d ylo(gather_avx512(grid.y.grid, jm1));
+      __m512d yhi(gather_avx512(grid.y.grid, j));
+      __m512d tt(_mm512_div_pd(_mm512_sub_pd(xv, xlo),
+                               _mm512_sub_pd(xhi, xlo)));
+      __m512d uu(_mm512_div_pd(_mm512_sub_pd(yv, ylo),
+                               _mm512_sub_pd(yhi, ylo)));
+
+      __m512i idx(_mm512_add_epi64(_mm512_mul_epu32(jm1, nx), im1));
+      __m512i idx_up(_mm512_add_epi64(idx, nx));
+      __m512d z0(gather_avx512(grid.z, idx));
+      __m512d z1(gather_avx512(grid.z, _mm512_add_epi64(idx, ione)));
+      __m512d z2(gather_avx512(grid.z, _mm512_add_epi64(idx_up, ione)));
+      __m512d z3(gather_avx512(grid.z, idx_up));
+
+      __m512d omt(_mm512_sub_pd(one, tt));
+      __m512d omu(_mm512_sub_pd(one, uu));
+      __m512d value(_mm512_mul_pd(_mm512_mul_pd(omt, omu), z0));
+      value = _mm512_add_pd(value, _mm512_mul_pd(_mm512_mul_pd(tt, omu), z1));
+      value = _mm512_add_pd(value, _mm512_mul_pd(_mm512_mul_pd(tt, uu), z2));
+      value = _mm512_add_pd(value, _mm512_mul_pd(_mm512_mul_pd(omt, uu), z3));
+      _mm512_storeu_pd(out + k, value);
+   }
+   return k;
+}
+
+#endif // ST_FACILITIES_X86_KERNELS
+
+} // anonymous namespace
+
+namespace st_facilities {
+
+namespace BilinearSimd {
+
+std::vector<Kernel> kernels() {
+   std::vector<Kernel> supported;
+#ifdef ST_FACILITIES_X86_KERNELS
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) {
+      supported.push_back(&evaluate_avx512);
+   }
+   if (__builtin_cpu_supports("avx2")) {
+      supported.push_back(&evaluate_avx2);
+   }
+   supported.push_back(&evaluate_sse2);
+#endif
+   return supported;
+}
+
+Kernel kernel() {
+   std::vector<Kernel> supported(kernels());
+   return supported.empty() ? 0 : supported.front();
+}
+
+} // namespace BilinearSimd
+
+} // namespace st_facilities
@@ -0,0 +1,65 @@
+/**
+ * @file BilinearSimd.h
+ * @brief Vectorized kernels used by Bilinear::evaluate for batches of
+ * points.  This header is private to the st_facilities library.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_BilinearSimd_h
+#define st_facilities_BilinearSimd_h
+
+#include <cstddef>
+
+#include <vector>
+
+namespace st_facilities {
+
+namespace BilinearSimd {
+
+/**
+ * @struct Axis
+ * @brief One padded grid axis.  If the axis (apart from the padding
+ * nodes) is uniformly spaced, the bracketing index is computed
+ * arithmetically from the BinLocator parameters.
+ */
+struct Axis {
+   const double * grid;
+   size_t n;
+   bool uniform;
+   size_t first;
+   size_t nsteps;
+   double origin;
+   double invStep;
+};
+
+/**
+ * @struct Grid
+ * @brief Read-only view of the padded Bilinear grid.
+ */
+struct Grid {
+   Axis x;
+   Axis y;
+   const double * z;
+};
+
+/// Signature of a batch kernel.  It evaluates the points in whole
+/// vector-width blocks and returns the number of points done.  It
+/// stops at the first block containing an out-of-range point, so that
+/// the caller can finish (and report errors) with the scalar code.
+typedef size_t (*Kernel)(const Grid & grid, const double * x,
+                         const double * y, double * out, size_t n);
+
+/// @return The kernels supported by the host CPU, widest first.  This
+/// is empty if none is available on this platform.
+std::vector<Kernel> kernels();
+
+/// @return The widest kernel supported by the host CPU, or 0 if none
+/// is available on this platform.
+Kernel kernel();
+
+} // namespace BilinearSimd
+
+} // namespace st_facilities
+
+#endif // st_facilities_BilinearSimd_h
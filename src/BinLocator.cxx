@@ -0,0 +1,105 @@
+/**
+ * @file BinLocator.cxx
+ * @brief Implementation for BinLocator.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <algorithm>
+
+#include "st_facilities/BinLocator.h"
+
+namespace {
+/// Largest allowed deviation of a node from a uniform grid, in units
+/// of the grid step.  This guarantees the arithmetic index is within
+/// one bin of the true one.
+   const double s_tolerance(1e-3);
+}
+
+namespace st_facilities {
+
+BinLocator::BinLocator()
+   : m_spacing(IRREGULAR), m_first(0), m_nsteps(0), m_origin(0),
+     m_invStep(0) {}
+
+BinLocator::BinLocator(const std::vector<double> & grid)
+   : m_grid(grid), m_spacing(IRREGULAR), m_first(0), m_nsteps(0),
+     m_origin(0), m_invStep(0) {
+   if (m_grid.size() < 3) {
+      return;
+   }
+// Try the full grid, then allow for a single padding node at either
+// or both ends, as in the grids used by Bilinear.
+   size_t last(m_grid.size() - 1);
+   size_t ranges[4][2] = {{0, last}, {1, last - 1}, {1, last}, {0, last - 1}};
+   for (size_t k(0); k < 4; k++) {
+      if (checkSpacing(ranges[k][0], ranges[k][1], false) ||
+          checkSpacing(ranges[k][0], ranges[k][1], true)) {
+         return;
+      }
+   }
+}
+
+bool BinLocator::checkSpacing(size_t first, size_t last, bool logScale) {
+   if (last - first < 2) {
+      return false;
+   }
+   if (logScale && !(m_grid[first] > 0)) {
+      return false;
+   }
+   std::vector<double> xx(m_grid.begin() + first, m_grid.begin() + last + 1);
+   if (logScale) {
+      for (size_t k(0); k < xx.size(); k++) {
+         xx[k] = std::log(xx[k]);
+      }
+   }
+   double step((xx.back() - xx.front())/(xx.size() - 1));
+   if (!(step > 0)) {
+      return false;
+   }
+   for (size_t k(1); k < xx.size() - 1; k++) {
+      if (!(std::fabs(xx[k] - (xx.front() + k*step)) <= s_tolerance*step)) {
+         return false;
+      }
+   }
+   m_spacing = logScale ? LOG_UNIFORM : UNIFORM;
+   m_first = first;
+   m_nsteps = xx.size() - 1;
+   m_origin = xx.front();
+   m_invStep = 1./step;
+   return true;
+}
+
+size_t BinLocator::upperBound(double x) const {
+   if (m_spacing == IRREGULAR || x != x) {
+      return std::upper_bound(m_grid.begin(), m_grid.end(), x)
+         - m_grid.begin();
+   }
+   double tt;
+   if (m_spacing == UNIFORM) {
+      tt = (x - m_origin)*m_invStep;
+   } else {
+      tt = x > 0 ? (std::log(x) - m_origin)*m_invStep : -1.;
+   }
+   size_t indx;
+   if (!(tt >= 0)) {
+      indx = m_first;
+   } else if (tt >= m_nsteps) {
+      indx = m_first + m_nsteps + 1;
+   } else {
+      indx = m_first + static_cast<size_t>(tt) + 1;
+   }
+   indx = std::min(indx, m_grid.size());
+// Correct for rounding and for the non-uniform end nodes.
+   while (indx < m_grid.size() && m_grid[indx] <= x) {
+      indx++;
+   }
+   while (indx > 0 && m_grid[indx-1] > x) {
+      indx--;
+   }
+   return indx;
+}
+
+} // namespace st_facilities
@@ -0,0 +1,164 @@
+/**
+ * @file CubicSpline.cxx
+ * @brief Implementation for CubicSpline.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "st_facilities/CubicSpline.h"
+#include "st_facilities/Interpolator1D.h"
+
+namespace {
+   double sign(double x) {
+      return x > 0 ? 1. : (x < 0 ? -1. : 0.);
+   }
+}
+
+namespace st_facilities {
+
+CubicSpline::CubicSpline(const std::vector<double> & x,
+                         const std::vector<double> & y,
+                         Method method)
+   : m_x(x), m_method(method), m_index(0) {
+   if (m_x.size() < 2 || m_x.size() != y.size()) {
+      throw std::invalid_argument("CubicSpline: x and y must have the "
+                                  "same size, with at least two points");
+   }
+   for (size_t i(1); i < m_x.size(); i++) {
+      if (!(m_x[i] > m_x[i-1])) {
+         throw std::invalid_argument("CubicSpline: abscissa values must "
+                                     "be strictly ascending");
+      }
+   }
+   m_ylast = y.back();
+
+// Both methods are cubic Hermite interpolants; they differ only in
+// the slopes assigned to the nodes.
+   std::vector<double> slopes;
+   computeSlopes(y, slopes);
+   m_coeffs.resize(4*(m_x.size() - 1));
+   for (size_t i(0); i < m_x.size() - 1; i++) {
+      double h(m_x[i+1] - m_x[i]);
+      double s((y[i+1] - y[i])/h);
+      double * coeffs(&m_coeffs[4*i]);
+      coeffs[0] = y[i];
+      coeffs[1] = slopes[i];
+      coeffs[2] = (3.*s - 2.*slopes[i] - slopes[i+1])/h;
+      coeffs[3] = (slopes[i] + slopes[i+1] - 2.*s)/(h*h);
+   }
+}
+
+void CubicSpline::computeSlopes(const std::vector<double> & y,
+                                std::vector<double> & slopes) const {
+   size_t n(m_x.size());
+   std::vector<double> h(n - 1);
+   std::vector<double> s(n - 1);
+   for (size_t i(0); i < n - 1; i++) {
+      h[i] = m_x[i+1] - m_x[i];
+      s[i] = (y[i+1] - y[i])/h[i];
+   }
+   slopes.resize(n);
+   if (n == 2) {
+      slopes[0] = slopes[1] = s[0];
+      return;
+   }
+   if (m_method == MONOTONE) {
+      for (size_t i(1); i < n - 1; i++) {
+         double p((s[i-1]*h[i] + s[i]*h[i-1])/(h[i-1] + h[i]));
+         slopes[i] = (sign(s[i-1]) + sign(s[i]))
+            *std::min(std::min(std::fabs(s[i-1]), std::fabs(s[i])),
+                      0.5*std::fabs(p));
+      }
+// One-sided parabolic estimates at the ends, limited as in Steffen's
+// eqs. (26) and (27).
+      size_t m(n - 2);
+      double p0(s[0]*(1. + h[0]/(h[0] + h[1])) - s[1]*h[0]/(h[0] + h[1]));
+      double pn(s[m]*(1. + h[m]/(h[m] + h[m-1]))
+                - s[m-1]*h[m]/(h[m] + h[m-1]));
+      double ends[2][2] = {{p0, s[0]}, {pn, s[m]}};
+      for (size_t k(0); k < 2; k++) {
+         double p(ends[k][0]);
+         double slope(ends[k][1]);
+         if (p*slope <= 0) {
+            p = 0;
+         } else if (std::fabs(p) > 2.*std::fabs(slope)) {
+            p = 2.*slope;
+         }
+         slopes[k == 0 ? 0 : n - 1] = p;
+      }
+      return;
+   }
+// Natural spline: continuity of the second derivative at the interior
+// nodes and zero second derivative at the ends give a tridiagonal
+// system for the slopes, solved here by forward elimination and back
+// substitution.
+   std::vector<double> diag(n);
+   std::vector<double> upper(n);
+   std::vector<double> rhs(n);
+   diag[0] = 2.;
+   upper[0] = 1.;
+   rhs[0] = 3.*s[0];
+   for (size_t i(1); i < n; i++) {
+      double lower, d, u, r;
+      if (i < n - 1) {
+         lower = h[i];
+         d = 2.*(h[i-1] + h[i]);
+         u = h[i-1];
+         r = 3.*(h[i]*s[i-1] + h[i-1]*s[i]);
+      } else {
+         lower = 1.;
+         d = 2.;
+         u = 0;
+         r = 3.*s[n-2];
+      }
+      double factor(lower/diag[i-1]);
+      diag[i] = d - factor*upper[i-1];
+      upper[i] = u;
+      rhs[i] = r - factor*rhs[i-1];
+   }
+   slopes[n-1] = rhs[n-1]/diag[n-1];
+   for (size_t i(n - 1); i > 0; i--) {
+      slopes[i-1] = (rhs[i-1] - upper[i-1]*slopes[i])/diag[i-1];
+   }
+}
+
+double CubicSpline::operator()(double xx) {
+   if (!(xx >= m_x.front() && xx <= m_x.back())) {
+      std::ostringstream message;
+      message << "CubicSpline:\n"
+              << "abscissa value out-of-range, "
+              << xx << " is not in ("
+              << m_x.front() << ", "
+              << m_x.back() << ")";
+      throw std::range_error(message.str());
+   }
+   if (xx == m_x.back()) {
+      return m_ylast;
+   }
+   m_index = Interpolator1D::hunt(m_x, xx, m_index);
+   const double * coeffs(&m_coeffs[4*m_index]);
+   double t(xx - m_x[m_index]);
+   return coeffs[0] + t*(coeffs[1] + t*(coeffs[2] + t*coeffs[3]));
+}
+
+void CubicSpline::evaluate(const double * xx, double * yy, size_t n) {
+   for (size_t k(0); k < n; k++) {
+      yy[k] = operator()(xx[k]);
+   }
+}
+
+void CubicSpline::evaluate(const std::vector<double> & xx,
+                           std::vector<double> & yy) {
+   yy.resize(xx.size());
+   if (!xx.empty()) {
+      evaluate(&xx[0], &yy[0], xx.size());
+   }
+}
+
+} // namespace st_facilities
@@ -0,0 +1,48 @@
+/**
+ * @file FileStamp.cxx
+ * @brief Implementation of getFileStamp.
+ *
+ * $Header$
+ */
+
+#include <sys/stat.h>
+
+#include <climits>
+#include <cstdlib>
+
+#include "FileStamp.h"
+
+namespace st_facilities {
+
+bool getFileStamp(const std::string & filename, std::string & path,
+                  FileStamp & stamp, bool regularOnly) {
+   struct stat info;
+   if (::stat(filename.c_str(), &info) != 0) {
+      return false;
+   }
+   if (regularOnly && (info.st_mode & S_IFMT) != S_IFREG) {
+      return false;
+   }
+#ifdef WIN32
+   char resolved[_MAX_PATH];
+   if (!_fullpath(resolved, filename.c_str(), _MAX_PATH)) {
+      return false;
+   }
+   long nsec(0);
+#else
+   char resolved[PATH_MAX];
+   if (!::realpath(filename.c_str(), resolved)) {
+      return false;
+   }
+#ifdef __APPLE__
+   long nsec(info.st_mtimespec.tv_nsec);
+#else
+   long nsec(info.st_mtim.tv_nsec);
+#endif
+#endif
+   path = resolved;
+   stamp = FileStamp(info.st_mtime, nsec, info.st_size, info.st_ino);
+   return true;
+}
+
+} // namespace st_facilities
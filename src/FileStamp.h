@@ -0,0 +1,35 @@
+/**
+ * @file FileStamp.h
+ * @brief Identification of files and their versions for the caches of
+ * data read from files.  This header is private to the st_facilities
+ * library.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_FileStamp_h
+#define st_facilities_FileStamp_h
+
+#include <sys/types.h>
+
+#include <ctime>
+#include <string>
+#include <tuple>
+
+namespace st_facilities {
+
+/// Modification time (seconds and nanoseconds), size and inode of a
+/// file, used to detect changes.
+typedef std::tuple<time_t, long, off_t, ino_t> FileStamp;
+
+/// @brief Find the canonical path of a file, so that different names
+///        for it share a cache entry, and its stamp.
+/// @param regularOnly If true, fail for anything but a regular file.
+/// @return false if the file cannot be stat'ed, e.g., for cfitsio
+///         extended file names, in which case it should not be cached.
+bool getFileStamp(const std::string & filename, std::string & path,
+                  FileStamp & stamp, bool regularOnly=false);
+
+} // namespace st_facilities
+
+#endif // st_facilities_FileStamp_h
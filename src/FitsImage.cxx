@@ -8,12 +8,18 @@
  */
 
 #include <cmath>
+#include <cstdio>
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 
+#include "fitsio.h"
+
 #include "tip/Header.h"
 #include "tip/IFileSvc.h"
 #include "tip/Image.h"
@@ -23,16 +29,68 @@
 
 #include "st_facilities/FitsImage.h"
 
+#include "LruCache.h"
+#include "Parallel.h"
+
+namespace {
+   void checkStatus(int status, fitsfile * fptr) {
+      if (status == 0) {
+         return;
+      }
+      fits_report_error(stderr, status);
+      if (fptr) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+      }
+      throw std::runtime_error("FitsImage::readPlanes:\n cfitsio error.");
+   }
+
+/// Default number of planes held by the ON_DEMAND plane cache.
+   const size_t s_planeCacheSize(16);
+
+/// Serializes plane reads if cfitsio was built without thread support.
+   std::mutex s_cfitsioMutex;
+
+   const double s_degToRad(std::acos(-1.)/180.);
+
+/// Read a keyword, leaving value unchanged if it is absent.
+   template <typename T>
+   void getOptionalKeyword(const tip::Header & header,
+                           const std::string & keyword, T & value) {
+      try {
+         header[keyword].get(value);
+      } catch (...) {
+      }
+   }
+}
+
 namespace st_facilities {
 
+/// Planes keyed by plane number, at most a given number of them.
+class FitsImage::PlaneCache
+   : public LruCache<size_t, std::shared_ptr<const std::vector<float> > > {
+
+public:
+
+   typedef std::shared_ptr<const std::vector<float> > Plane;
+
+   explicit PlaneCache(size_t maxPlanes) : LruCache(maxPlanes) {}
+
+};
+
 FitsImage::FitsImage(const std::string & fitsfile,
-                     const std::string & extension) 
-   : m_filename(fitsfile), m_extension(extension) {
+                     const std::string & extension,
+                     LoadMode mode) 
+   : m_filename(fitsfile), m_extension(extension), m_mode(mode),
+     m_hasProjection(false) {
    read_fits_image();
 }
 
 FitsImage::FitsImage(const FitsImage & rhs) 
-   : m_filename(rhs.m_filename), m_extension(rhs.m_extension) {
+   : m_filename(rhs.m_filename), m_extension(rhs.m_extension),
+     m_mode(rhs.m_mode), m_mappedImage(rhs.m_mappedImage),
+     m_planeCache(copyPlaneCache(rhs.m_planeCache)), m_wcs(rhs.m_wcs),
+     m_hasProjection(rhs.m_hasProjection), m_projError(rhs.m_projError) {
    m_axes = rhs.m_axes;
    m_image = rhs.m_image;
 }
@@ -43,12 +101,26 @@ FitsImage & FitsImage::operator=(const FitsImage & rhs) {
       m_extension = rhs.m_extension;
       m_axes = rhs.m_axes;
       m_image = rhs.m_image;
+      m_mode = rhs.m_mode;
+      m_mappedImage = rhs.m_mappedImage;
+      m_planeCache = copyPlaneCache(rhs.m_planeCache);
+      m_wcs = rhs.m_wcs;
+      m_hasProjection = rhs.m_hasProjection;
+      m_projError = rhs.m_projError;
    }
    return *this;
 }
 
 FitsImage::~FitsImage() {}
 
+std::shared_ptr<FitsImage::PlaneCache>
+FitsImage::copyPlaneCache(const std::shared_ptr<PlaneCache> & cache) {
+   if (!cache) {
+      return cache;
+   }
+   return std::shared_ptr<PlaneCache>(new PlaneCache(cache->capacity()));
+}
+
 void FitsImage::getAxisDims(std::vector<int> &axisDims) const {
    axisDims.clear();
    for (unsigned int i = 0; i < m_axes.size(); i++) {
@@ -65,7 +137,8 @@ void FitsImage::getAxisNames(std::vector<std::string> &axisNames) const {
 
 void FitsImage::getCelestialArrays(std::vector<double> & lonArray,
                                    std::vector<double> & latArray) const {
-   astro::SkyProj * proj = skyProjCreate(m_filename, m_extension);
+   checkProjection();
+   std::unique_ptr<const astro::SkyProj> proj(m_wcs.create());
 
    int npix = m_axes[0].size*m_axes[1].size;
    lonArray.clear();
@@ -81,28 +154,90 @@ void FitsImage::getCelestialArrays(std::vector<double> & lonArray,
          latArray.push_back(dir.second);
       }
    }
-   delete proj;
 }
          
 void FitsImage::getSolidAngles(std::vector<double> &solidAngles) const {
-   astro::SkyProj * proj = skyProjCreate(m_filename, m_extension);
+   getSolidAngles(solidAngles, 1);
+}
 
-   int npix = m_axes[0].size*m_axes[1].size;
-   solidAngles.clear();
-   solidAngles.reserve(npix);
+void FitsImage::getSolidAngles(std::vector<double> & solidAngles,
+                               size_t nthreads) const {
+   checkProjection();
 
-// NB: wcslib starts indexing pixel arrays with 1, not 0.
-   for (int j = 1; j < m_axes[1].size + 1; j++) {
-      for (int i = 1; i < m_axes[0].size + 1; i++) {
-         astro::SkyDir A(i - 0.5, j - 0.5, *proj);
-         astro::SkyDir B(i + 0.5, j - 0.5, *proj);
-         astro::SkyDir C(i + 0.5, j + 0.5, *proj);
-         astro::SkyDir D(i - 0.5, j + 0.5, *proj);
+   size_t nx(m_axes[0].size);
+   size_t ny(m_axes[1].size);
+   solidAngles.resize(nx*ny);
+
+   std::vector<double> rowSolidAngles;
+   if (getRowSolidAngles(rowSolidAngles)) {
+      for (size_t j(0); j < ny; j++) {
+         std::fill(solidAngles.begin() + j*nx, 
+                   solidAngles.begin() + (j + 1)*nx, rowSolidAngles[j]);
+      }
+      return;
+   }
 
-         solidAngles.push_back(solidAngle(A, B, C, D));
+// Adjacent pixels share corners, so the directions of one row of
+// corners are computed once and used for the pixels on either side.
+// wcslib projections are not thread-safe, so each thread creates its
+// own.  NB: wcslib starts indexing pixel arrays with 1, not 0, so the
+// corners of pixel (i, j) are at i + 0.5 +/- 0.5, j + 0.5 +/- 0.5.
+   Parallel::forChunks(ny, nthreads, 8, [&](size_t jbegin, size_t jend) {
+      std::unique_ptr<astro::SkyProj> proj(m_wcs.create());
+      std::vector<astro::SkyDir> lower, upper;
+      getCornerRow(*proj, nx, jbegin + 0.5, lower);
+      for (size_t j(jbegin); j < jend; j++) {
+         getCornerRow(*proj, nx, j + 1.5, upper);
+         double * row(&solidAngles[j*nx]);
+         for (size_t i(0); i < nx; i++) {
+            row[i] = solidAngle(lower[i], lower[i+1], upper[i+1], upper[i]);
+         }
+         lower.swap(upper);
       }
+   });
+}
+
+bool FitsImage::getRowSolidAngles(std::vector<double> & rowSolidAngles) const {
+   checkProjection();
+   if (!m_wcs.isRegularCylindrical()) {
+      return false;
+   }
+// The pixels of row j span the longitude interval |CDELT1| and lie
+// between the latitudes of the pixel edges j + 0.5 -/+ 0.5 (wcslib
+// pixel indices start at 1), so the solid angle is exactly
+// dlon*(sin(b_upper) - sin(b_lower)).  For CAR, latitude is linear in
+// the pixel ordinate; for CEA (with lambda = 1), sin(latitude) is.
+   double dlon(std::fabs(m_wcs.cdelt[0])*s_degToRad);
+   size_t ny(m_axes[1].size);
+   std::vector<double> sinb(ny + 1);
+   for (size_t j(0); j < ny + 1; j++) {
+      double y((j + 0.5 - m_wcs.crpix[1])*m_wcs.cdelt[1]);
+      double value;
+      if (m_wcs.trans == "CAR") {
+         value = std::sin(std::max(-90., std::min(90., y))*s_degToRad);
+      } else {
+         value = std::max(-1., std::min(1., y*s_degToRad));
+      }
+      sinb[j] = value;
+   }
+   rowSolidAngles.resize(ny);
+   for (size_t j(0); j < ny; j++) {
+      rowSolidAngles[j] = dlon*std::fabs(sinb[j+1] - sinb[j]);
+   }
+   return true;
+}
+
+bool FitsImage::WcsParams::isRegularCylindrical() const {
+   return (trans == "CAR" || trans == "CEA") && crval[1] == 0 && crota2 == 0;
+}
+
+void FitsImage::getCornerRow(const astro::SkyProj & proj, size_t nx,
+                             double y, std::vector<astro::SkyDir> & row) {
+   row.clear();
+   row.reserve(nx + 1);
+   for (size_t i(0); i < nx + 1; i++) {
+      row.push_back(astro::SkyDir(i + 0.5, y, proj));
    }
-   delete proj;
 }
 
 double FitsImage::solidAngle(const astro::SkyDir & A,
@@ -121,18 +256,96 @@ double FitsImage::solidAngle(const astro::SkyDir & A,
 }
 
 void FitsImage::getImageData(std::vector<double> & imageData) const {
-   imageData.resize(m_image.size());
-   for (unsigned int i = 0; i < m_image.size(); i++) {
-      imageData.at(i) = m_image.at(i);
+   if (m_mappedImage.isMapped() || m_mode == ON_DEMAND) {
+      imageView().get(imageData);
+      return;
+   }
+   imageData.assign(m_image.begin(), m_image.end());
+}
+
+ImageView FitsImage::imageView() const {
+   if (m_mappedImage.isMapped()) {
+      return m_mappedImage;
+   }
+   if (m_mode == ON_DEMAND) {
+      return ImageView(readPlanes(0, numPlanes()));
+   }
+   return ImageView(m_image.empty() ? 0 : &m_image[0], m_image.size());
+}
+
+size_t FitsImage::numPlanes() const {
+   return m_axes.size() > 2 ? m_axes[2].size : 1;
+}
+
+ImageView FitsImage::plane(size_t k) const {
+   if (m_axes.size() < 2) {
+      throw std::runtime_error("FitsImage::plane: no image has been read.");
+   }
+   if (k >= numPlanes()) {
+      std::ostringstream message;
+      message << "FitsImage::plane: plane " << k << " requested, but "
+              << m_filename << " has " << numPlanes() << " planes.";
+      throw std::out_of_range(message.str());
+   }
+   size_t npix(m_axes[0].size*m_axes[1].size);
+   if (m_mode != ON_DEMAND) {
+      return imageView().subView(k*npix, npix);
+   }
+   PlaneCache::Plane data;
+   if (!m_planeCache->find(k, data)) {
+      data = m_planeCache->insert(k, readPlanes(k, 1));
+   }
+   return ImageView(data);
+}
+
+void FitsImage::setPlaneCacheSize(size_t nplanes) {
+   if (m_planeCache) {
+      m_planeCache->setCapacity(nplanes);
+   }
+}
+
+std::shared_ptr<const std::vector<float> >
+FitsImage::readPlanes(size_t first, size_t nplanes) const {
+   std::shared_ptr<std::vector<float> > 
+      data(new std::vector<float>(m_axes[0].size*m_axes[1].size*nplanes));
+   readPixels(first, nplanes, &(*data)[0]);
+   return data;
+}
+
+void FitsImage::readPixels(size_t first, size_t nplanes, float * data) const {
+   std::string hduname(m_filename);
+   if (m_extension != "") {
+      hduname += "[" + m_extension + "]";
    }
+   std::unique_lock<std::mutex> lock(s_cfitsioMutex, std::defer_lock);
+   if (!fits_is_reentrant()) {
+      lock.lock();
+   }
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_file(&fptr, hduname.c_str(), READONLY, &status);
+   checkStatus(status, 0);
+
+// Read the rectangular subset spanning the requested planes.
+   long fpixel[3] = {1, 1, static_cast<long>(first) + 1};
+   long lpixel[3] = {m_axes[0].size, m_axes[1].size,
+                     static_cast<long>(first + nplanes)};
+   long inc[3] = {1, 1, 1};
+// Pixels of integer images equal to BLANK are returned as NaN.
+   float nulval(std::numeric_limits<float>::quiet_NaN());
+   int anynul(0);
+   fits_read_subset(fptr, TFLOAT, fpixel, lpixel, inc, &nulval, data,
+                    &anynul, &status);
+   checkStatus(status, fptr);
+
+   fits_close_file(fptr, &status);
+   checkStatus(status, 0);
 }
 
 void FitsImage::read_fits_image() {
    std::unique_ptr<const tip::Image>
       image(tip::IFileSvc::instance().readImage(m_filename, m_extension));
 
-   image->get(m_image);
-
    std::vector<tip::PixOrd_t> dims = image->getImageDimensions();
 
    if (!(dims.size() == 2 || dims.size() == 3)) {
@@ -164,13 +377,19 @@ void FitsImage::read_fits_image() {
                      const_cast<char *>("CTYPE2"), 
                      const_cast<char *>("CTYPE3")};
 
+// Images that are not sky maps may lack the WCS keywords, in which
+// case the FITS default values are used.
    const tip::Header & header = image->getHeader();
    for (unsigned int i = 0; i < dims.size(); i++) {
       m_axes.at(i).size = static_cast<int>(dims.at(i));
-      header[crval[i]].get(m_axes.at(i).refVal);
-      header[cdelt[i]].get(m_axes.at(i).step);
-      header[crpix[i]].get(m_axes.at(i).refPixel);
-      header[ctype[i]].get(m_axes.at(i).axisType);
+      m_axes.at(i).refVal = 0;
+      m_axes.at(i).step = 1;
+      m_axes.at(i).refPixel = 0;
+      m_axes.at(i).axisType = "";
+      getOptionalKeyword(header, crval[i], m_axes.at(i).refVal);
+      getOptionalKeyword(header, cdelt[i], m_axes.at(i).step);
+      getOptionalKeyword(header, crpix[i], m_axes.at(i).refPixel);
+      getOptionalKeyword(header, ctype[i], m_axes.at(i).axisType);
 // Check for logarithmic scaling.
       int offset = m_axes.at(i).axisType.substr(0).find("log_");
       if (offset == 0) {
@@ -179,33 +398,62 @@ void FitsImage::read_fits_image() {
          m_axes[i].logScale = false;
       }
    }
+
+   setProjection(header);
+
+// The pixels are read with cfitsio, as for ON_DEMAND mode, rather
+// than tip, so that all load modes give the same values.
+   if (m_mode == ON_DEMAND) {
+      m_planeCache.reset(new PlaneCache(s_planeCacheSize));
+   } else if (m_mode != MEMORY_MAP ||
+              !ImageView::mapFits(m_filename, m_extension, m_mappedImage)) {
+      m_image.resize(m_axes[0].size*m_axes[1].size*numPlanes());
+      readPixels(0, numPlanes(), &m_image[0]);
+   }
 }
 
 astro::SkyProj * FitsImage::skyProjCreate(const std::string & fitsFile,
                                           const std::string & extension) {
-   const tip::Image * image = 
-      tip::IFileSvc::instance().readImage(fitsFile, extension);
+   std::unique_ptr<const tip::Image> 
+      image(tip::IFileSvc::instance().readImage(fitsFile, extension));
+   WcsParams params;
+   params.read(image->getHeader(), fitsFile + "[" + extension + "]");
+   return params.create();
+}
 
-   const tip::Header & header = image->getHeader();
+void FitsImage::setProjection(const tip::Header & header) {
+   try {
+      m_wcs.read(header, m_filename + "[" + m_extension + "]");
+// Check that the keywords define a valid projection.
+      std::unique_ptr<astro::SkyProj> proj(m_wcs.create());
+      m_hasProjection = true;
+      m_projError = "";
+   } catch (std::exception & eObj) {
+// Images that are not sky maps have no projection; the error is
+// reported only if one is requested.
+      m_hasProjection = false;
+      m_projError = eObj.what();
+   }
+}
 
-   bool galactic;
+void FitsImage::WcsParams::read(const tip::Header & header,
+                                const std::string & hduName) {
    std::string ctype;
-   header["CTYPE1"].get(ctype);
+   getOptionalKeyword(header, "CTYPE1", ctype);
    if (ctype.substr(0, 2) == "RA") {
       galactic = false;
    } else if (ctype.substr(0, 4) == "GLON") {
       galactic = true;
    } else {
       throw std::runtime_error("Unrecognized coordinate system in " 
-                               + fitsFile + "[" + extension + "]");
+                               + hduName);
    }
    
-   std::string trans("");
+   trans = "";
    if (ctype.size() > 7) {
       trans = ctype.substr(ctype.size() - 3, 3);
    }
    
-   double crpix[2], crval[2], cdelt[2];
    header["CRPIX1"].get(crpix[0]);
    header["CRVAL1"].get(crval[0]);
    header["CDELT1"].get(cdelt[0]);
@@ -214,18 +462,23 @@ astro::SkyProj * FitsImage::skyProjCreate(const std::string & fitsFile,
    header["CRVAL2"].get(crval[1]);
    header["CDELT2"].get(cdelt[1]);
 
-   double crota2(0);
-   try {
-      header["CROTA2"].get(crota2);
-   } catch (...) {
-   }
-
-   delete image;
+   crota2 = 0;
+   getOptionalKeyword(header, "CROTA2", crota2);
+}
 
-   astro::SkyProj * proj = 
-      new astro::SkyProj(trans, crpix, crval, cdelt, crota2, galactic);
+astro::SkyProj * FitsImage::WcsParams::create() const {
+// SkyProj takes non-const arrays.
+   double pix[2] = {crpix[0], crpix[1]};
+   double val[2] = {crval[0], crval[1]};
+   double delt[2] = {cdelt[0], cdelt[1]};
+   return new astro::SkyProj(trans, pix, val, delt, crota2, galactic);
+}
 
-   return proj;
+void FitsImage::checkProjection() const {
+   if (!m_hasProjection) {
+      throw std::runtime_error(m_projError != "" ? m_projError :
+                               "FitsImage: no WCS projection has been set");
+   }
 }
 
 } // namespace st_facilities
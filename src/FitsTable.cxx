@@ -8,146 +8,272 @@
  */
 
 #include <cmath>
+#include <cstdio>
 
 #include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <tuple>
+
+#include "fitsio.h"
 
-#include "tip/IFileSvc.h"
 #include "tip/Table.h"
 
 #include "st_facilities/Bilinear.h"
+#include "st_facilities/BinLocator.h"
 #include "st_facilities/FitsTable.h"
 
+#include "FileStamp.h"
+#include "LruCache.h"
+
 namespace {
-   size_t binIndex(double x, const std::vector<double> & xx) {
-      std::vector<double>::const_iterator ix = 
-         std::upper_bound(xx.begin(), xx.end(), x);
-      return ix - xx.begin();
+   void checkStatus(int status, fitsfile * fptr) {
+      if (status == 0) {
+         return;
+      }
+      fits_report_error(stderr, status);
+      if (fptr) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+      }
+      throw std::runtime_error("FitsTable::getVectorData:\n cfitsio error.");
    }
+
+/// Canonical path of the file, extname, tablename and nrow.
+   typedef std::tuple<std::string, std::string, std::string, size_t>
+   TableKey;
 }
 
 namespace st_facilities {
 
+struct FitsTable::Data {
+   Data() : minCosTheta(0), maxValue(0) {}
+
+   Data(const Data & other)
+      : logEnergies(other.logEnergies), mus(other.mus),
+        values(other.values), ebounds(other.ebounds),
+        tbounds(other.tbounds), elocator(other.elocator),
+        tlocator(other.tlocator), minCosTheta(other.minCosTheta),
+        maxValue(other.maxValue),
+        interpolator(other.interpolator.get() ? 
+                     new Bilinear(*other.interpolator) : 0) {}
+
+   std::vector<double> logEnergies; 
+   std::vector<double> mus; 
+   std::vector<double> values;
+
+   std::vector<double> ebounds;
+   std::vector<double> tbounds;
+
+   BinLocator elocator;
+   BinLocator tlocator;
+   
+   double minCosTheta;
+
+   double maxValue;
+
+   std::unique_ptr<Bilinear> interpolator;
+
+   /// @return Approximate heap usage in bytes, including the padded
+   ///        copies of the grids held by the interpolator.
+   size_t memorySize() const {
+      size_t nx(logEnergies.size() + 2);
+      size_t ny(mus.size() + 2);
+      return sizeof(Data) + sizeof(Bilinear) + sizeof(double)*
+         (logEnergies.size() + mus.size() + values.size()
+          + 2*(ebounds.size() + tbounds.size()) + nx*ny + 2*(nx + ny));
+   }
+};
+
+/// Tables with a cost equal to their memory size.
+class FitsTable::Cache
+   : public LruCache<TableKey, std::shared_ptr<FitsTable::Data>, FileStamp> {
+
+public:
+
+   static Cache & instance() {
+      static Cache cache;
+      return cache;
+   }
+
+private:
+
+   Cache() : LruCache(64*1024*1024) {}
+
+};
+
 FitsTable::FitsTable(const std::string & filename,
                      const std::string & extname,
                      const std::string & tablename,
-                     size_t nrow) : m_interpolator(0) {
+                     size_t nrow) {
+   std::string path;
+   FileStamp stamp;
+   bool cacheable(getFileStamp(filename, path, stamp));
+   TableKey key(path, extname, tablename, nrow);
+   if (cacheable && Cache::instance().find(key, stamp, m_data)) {
+      return;
+   }
+   m_data.reset(new Data());
+   readData(filename, extname, tablename, nrow, *m_data);
+   if (cacheable) {
+      m_data = Cache::instance().insert(key, stamp, m_data,
+                                        m_data->memorySize());
+   }
+}
 
-   const tip::Table * table(tip::IFileSvc::instance().readTable(filename, 
-                                                                extname));
+void FitsTable::readData(const std::string & filename,
+                         const std::string & extname,
+                         const std::string & tablename,
+                         size_t nrow, Data & data) {
+   std::vector<std::string> fieldNames;
+   fieldNames.push_back("ENERG_LO");
+   fieldNames.push_back("ENERG_HI");
+   fieldNames.push_back("CTHETA_LO");
+   fieldNames.push_back("CTHETA_HI");
+   fieldNames.push_back(tablename);
+   std::vector< std::vector<double> > columns;
+   getVectorData(filename, extname, fieldNames, columns, nrow);
 
-   std::vector<double> elo, ehi;
-   getVectorData(table, "ENERG_LO", elo, nrow);
-   getVectorData(table, "ENERG_HI", ehi, nrow);
+   const std::vector<double> & elo(columns[0]);
+   const std::vector<double> & ehi(columns[1]);
    for (size_t k(0); k < elo.size(); k++) {
-      m_ebounds.push_back(std::log10(elo.at(k)));
-      m_logEnergies.push_back(std::log10(std::sqrt(elo.at(k)*ehi.at(k))));
+      data.ebounds.push_back(std::log10(elo.at(k)));
+      data.logEnergies.push_back(std::log10(std::sqrt(elo.at(k)*ehi.at(k))));
    }
-   m_ebounds.push_back(std::log10(ehi.back()));
+   data.ebounds.push_back(std::log10(ehi.back()));
 
-   std::vector<double> mulo, muhi;
-   getVectorData(table, "CTHETA_LO", mulo, nrow);
-   getVectorData(table, "CTHETA_HI", muhi, nrow);
+   const std::vector<double> & mulo(columns[2]);
+   const std::vector<double> & muhi(columns[3]);
    for (size_t i(0); i < muhi.size(); i++) {
-      m_tbounds.push_back(mulo.at(i));
-      m_mus.push_back((m_tbounds.at(i) + muhi.at(i))/2.);
+      data.tbounds.push_back(mulo.at(i));
+      data.mus.push_back((data.tbounds.at(i) + muhi.at(i))/2.);
    }
-   m_tbounds.push_back(muhi.back());
+   data.tbounds.push_back(muhi.back());
 
-   m_minCosTheta = mulo.front();
+   data.minCosTheta = mulo.front();
 
-   getVectorData(table, tablename, m_values, nrow);
-   m_maxValue = m_values.front();
-   for (size_t i(1); i < m_values.size(); i++) {
-      if (m_values.at(i) > m_maxValue) {
-         m_maxValue = m_values.at(i);
+   data.values.swap(columns[4]);
+   data.maxValue = data.values.front();
+   for (size_t i(1); i < data.values.size(); i++) {
+      if (data.values.at(i) > data.maxValue) {
+         data.maxValue = data.values.at(i);
       }
    }
 
 // Replicate nasty THF2 and RootEval::Table behavior from handoff_response,
 // by passing xlo, xhi, ylo, yhi values
    double xlo, xhi, ylo, yhi;
-   m_interpolator = new Bilinear(m_logEnergies, m_mus, m_values,
-                                 xlo=0., xhi=10., ylo=-1., yhi=1.);
+   data.interpolator.reset(new Bilinear(data.logEnergies, data.mus,
+                                        data.values, xlo=0., xhi=10.,
+                                        ylo=-1., yhi=1.));
 
-   delete table;
+   data.elocator = BinLocator(data.ebounds);
+   data.tlocator = BinLocator(data.tbounds);
 }
 
-FitsTable::FitsTable() : m_interpolator(0) {}
+FitsTable::FitsTable() : m_data(new Data()) {}
 
-FitsTable::FitsTable(const FitsTable & rhs) 
-   : m_interpolator(0), m_logEnergies(rhs.m_logEnergies), m_mus(rhs.m_mus),
-     m_values(rhs.m_values), m_ebounds(rhs.m_ebounds),
-     m_tbounds(rhs.m_tbounds), m_minCosTheta(rhs.m_minCosTheta), 
-     m_maxValue(rhs.m_maxValue) {
-   m_interpolator = new Bilinear(m_logEnergies, m_mus, m_values,
-                                 0, 10, -1, 1);
-}
+FitsTable::FitsTable(const FitsTable & rhs) : m_data(rhs.m_data) {}
 
-FitsTable::~FitsTable() { 
-   delete m_interpolator;
+FitsTable::~FitsTable() {}
+
+FitsTable::Data & FitsTable::mutableData() {
+   if (m_data.use_count() > 1) {
+      m_data.reset(new Data(*m_data));
+   }
+   return *m_data;
 }
 
 double FitsTable::
 value(double logenergy, double costh, bool interpolate) const {
+   const Data & data(*m_data);
    if (interpolate) {
-      if (costh > m_mus.back()) {
-         costh = m_mus.back();
+      if (costh > data.mus.back()) {
+         costh = data.mus.back();
       }
-      return (*m_interpolator)(logenergy, costh);
+      return (*data.interpolator)(logenergy, costh);
    }
 
    // if (logenergy <= m_logEnergies.at(1)) { // use first bin
    //    logenergy = m_logEnergies.at(1);
    // }
 
-   size_t ix = binIndex(logenergy, m_ebounds);
-   if (ix == m_ebounds.size()) {
+   size_t ix = data.elocator.upperBound(logenergy);
+   if (ix == data.ebounds.size()) {
       ix -= 1;
    }
    if (ix == 0) {
       ix = 1;
    }
-   size_t iy = binIndex(costh, m_tbounds);
+   size_t iy = data.tlocator.upperBound(costh);
    if (iy == 0) {
       iy = 1;
    }
-   if (iy > m_mus.size()) {
-      iy = m_mus.size();
+   if (iy > data.mus.size()) {
+      iy = data.mus.size();
    }
-   size_t indx = (iy - 1)*m_logEnergies.size() + ix - 1;
+   size_t indx = (iy - 1)*data.logEnergies.size() + ix - 1;
 
-   return m_values.at(indx);
+   return data.values.at(indx);
+}
+
+double FitsTable::maximum() const {
+   return m_data->maxValue;
+}
+
+double FitsTable::minCosTheta() const {
+   return m_data->minCosTheta;
+}
+
+const std::vector<double> & FitsTable::logEnergies() const {
+   return m_data->logEnergies;
+}
+
+const std::vector<double> & FitsTable::costhetas() const {
+   return m_data->mus;
+}
+
+const std::vector<double> & FitsTable::ebounds() const {
+   return m_data->ebounds;
+}
+
+const std::vector<double> & FitsTable::tbounds() const {
+   return m_data->tbounds;
 }
 
 void FitsTable::getValues(std::vector<double> & values) const {
-   values.clear();
-   for (size_t i(0); i < m_values.size(); i++) {
-      values.push_back(m_values.at(i));
-   }
+   values = m_data->values;
 }
 
 void FitsTable::getCornerPars(double logE, double costh,
                               double & tt, double & uu,
                               std::vector<double> & cornerEnergies,
                               std::vector<double> & cornerPars) const {
-   std::vector<double> corner_logE(4, 0);
-   std::vector<double> corner_costh(4, 0);
-   m_interpolator->getCorners(logE, costh, tt, uu, &corner_logE[0],
-                              &corner_costh[0], &cornerPars[0]);
-   for (size_t i(0); i < corner_logE.size(); i++) {
+   double corner_logE[4];
+   double corner_costh[4];
+   m_data->interpolator->getCorners(logE, costh, tt, uu, corner_logE,
+                                    corner_costh, &cornerPars[0]);
+   for (size_t i(0); i < 4; i++) {
       cornerEnergies[i] = std::pow(10., corner_logE[i]);
    }
 }
 
 double FitsTable::getPar(size_t ilogE, size_t icosth) const {
-   return m_interpolator->getPar(ilogE, icosth);
+   return m_data->interpolator->getPar(ilogE, icosth);
 }
 
 void FitsTable::setPar(size_t ilogE, size_t icosth, double value) {
-   m_interpolator->setPar(ilogE, icosth, value);
-   m_values.at(icosth*m_logEnergies.size() + ilogE) = value;
+   Data & data(mutableData());
+   data.interpolator->setPar(ilogE, icosth, value);
+   data.values.at(icosth*data.logEnergies.size() + ilogE) = value;
+}
+
+void FitsTable::setCacheBudget(size_t bytes) {
+   Cache::instance().setCapacity(bytes);
+}
+
+void FitsTable::clearCache() {
+   Cache::instance().clear();
 }
 
 void FitsTable::getVectorData(const tip::Table * table,
@@ -170,4 +296,51 @@ void FitsTable::getVectorData(const tip::Table * table,
    }
 }
 
+void FitsTable::getVectorData(const std::string & filename,
+                              const std::string & extname,
+                              const std::vector<std::string> & fieldNames,
+                              std::vector< std::vector<double> > & values,
+                              size_t nrow) {
+   std::string extfile(filename + "[" + extname + "]");
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_file(&fptr, extfile.c_str(), READONLY, &status);
+   checkStatus(status, 0);
+
+   LONGLONG firstrow(nrow + 1);
+   values.resize(fieldNames.size());
+   for (size_t i(0); i < fieldNames.size(); i++) {
+      int colnum(0);
+      fits_get_colnum(fptr, CASEINSEN,
+                      const_cast<char *>(fieldNames[i].c_str()),
+                      &colnum, &status);
+      checkStatus(status, fptr);
+
+      int typecode(0);
+      LONGLONG repeat(0);
+      LONGLONG width(0);
+      fits_get_coltypell(fptr, colnum, &typecode, &repeat, &width, &status);
+      checkStatus(status, fptr);
+      if (typecode < 0) {
+// Variable length array column: the cell length is in its descriptor.
+         LONGLONG offset(0);
+         fits_read_descriptll(fptr, colnum, firstrow, &repeat, &offset,
+                              &status);
+         checkStatus(status, fptr);
+      }
+
+      values[i].resize(repeat);
+      if (repeat > 0) {
+         double nulval(0);
+         int anynul(0);
+         fits_read_col(fptr, TDOUBLE, colnum, firstrow, 1, repeat, &nulval,
+                       &values[i][0], &anynul, &status);
+         checkStatus(status, fptr);
+      }
+   }
+
+   fits_close_file(fptr, &status);
+   checkStatus(status, 0);
+}
+
 } // namespace st_facilities
@@ -7,40 +7,893 @@
  */
 
 #include <cassert>
+#include <cctype>
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
 
-#include "tip/FileSummary.h"
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "tip/IFileSvc.h"
 #include "tip/Table.h"
 
 #include "st_facilities/FitsUtil.h"
 #include "st_facilities/Util.h"
 
+#include "Parallel.h"
+
 namespace st_facilities {
 
 #include "fitsio.h"
 
+namespace {
+   /// Report a cfitsio error and throw, closing fptr first if given.
+   void checkStatus(int status, const std::string & routine, 
+                    fitsfile * fptr=0) {
+      if (status == 0) {
+         return;
+      }
+      fits_report_error(stderr, status);
+      if (fptr) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+      }
+      throw std::runtime_error("FitsUtil::" + routine + ":\n cfitsio error.");
+   }
+
+   fitsfile * openTable(const std::string & filename, 
+                        const std::string & extName,
+                        const std::string & routine, 
+                        int iomode=READONLY) {
+      std::string hduname(filename);
+      if (extName != "") {
+         hduname += "[" + extName + "]";
+      }
+      int status(0);
+      fitsfile * fptr(0);
+      fits_open_file(&fptr, hduname.c_str(), iomode, &status);
+      checkStatus(status, routine);
+      return fptr;
+   }
+
+   /// Column number, elements per row and number of rows of a
+   /// column.  Variable length array columns are accepted only if
+   /// variable is given, in which case it is set accordingly.
+   void getColumnInfo(fitsfile * fptr, const std::string & columnName,
+                      const std::string & routine, int & colnum,
+                      size_t & repeat, size_t & nrows, bool * variable=0) {
+      int status(0);
+      fits_get_colnum(fptr, CASEINSEN, const_cast<char *>(columnName.c_str()),
+                      &colnum, &status);
+      int typecode(0);
+      LONGLONG rpt(0), width(0), numRows(0);
+      fits_get_coltypell(fptr, colnum, &typecode, &rpt, &width, &status);
+      fits_get_num_rowsll(fptr, &numRows, &status);
+      checkStatus(status, routine, fptr);
+      if (variable) {
+         *variable = typecode < 0;
+      } else if (typecode < 0) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+         throw std::runtime_error("FitsUtil::" + routine + ":\n column " 
+                                  + columnName + " has variable length.");
+      }
+      repeat = rpt;
+      nrows = numRows;
+   }
+
+   /// The number of rows per read: chunkRows if nonzero, otherwise
+   /// the number that fits in cfitsio's buffers.
+   size_t getChunkRows(fitsfile * fptr, size_t chunkRows,
+                       const std::string & routine) {
+      if (chunkRows > 0) {
+         return chunkRows;
+      }
+      int status(0);
+      long nrows(0);
+      fits_get_rowsize(fptr, &nrows, &status);
+      checkStatus(status, routine, fptr);
+      return nrows > 0 ? nrows : 1;
+   }
+
+   /// Read nrows rows of a column, starting at the zero-based firstRow.
+   void readRows(fitsfile * fptr, int colnum, size_t repeat, size_t firstRow,
+                 size_t nrows, double * values, const std::string & routine) {
+      if (nrows*repeat == 0) {
+         return;
+      }
+      int status(0);
+      double nulval(0);
+      int anynul(0);
+      fits_read_col(fptr, TDOUBLE, colnum, firstRow + 1, 1, nrows*repeat,
+                    &nulval, values, &anynul, &status);
+      checkStatus(status, routine, fptr);
+   }
+
+   /// Location and encoding of a binary table column within a row.
+   /// code is the TFORMn data type character if the column can be
+   /// decoded directly from the raw row bytes and zero otherwise,
+   /// e.g., for all columns of ASCII tables.
+   struct ColumnLayout {
+      int colnum;
+      size_t offset;
+      size_t repeat;
+      char code;
+      double scale;
+      double zero;
+   };
+
+   /// Number of bytes occupied in a row by a column with format tform.
+   size_t tformBytes(const std::string & tform, size_t & repeat, 
+                     char & code) {
+      size_t i(0);
+      repeat = 0;
+      for ( ; i < tform.size() && std::isdigit(tform[i]); i++) {
+         repeat = 10*repeat + (tform[i] - '0');
+      }
+      if (i == 0) {
+         repeat = 1;
+      }
+      code = i < tform.size() ? std::toupper(tform[i]) : ' ';
+      switch (code) {
+      case 'L': case 'B': case 'A':
+         return repeat;
+      case 'X':
+         return (repeat + 7)/8;
+      case 'I':
+         return 2*repeat;
+      case 'J': case 'E':
+         return 4*repeat;
+      case 'K': case 'D': case 'C': case 'P':
+         return 8*repeat;
+      case 'M': case 'Q':
+         return 16*repeat;
+      default:
+         throw std::runtime_error("FitsUtil: invalid TFORM value " + tform);
+      }
+   }
+
+   std::string keyName(const std::string & root, int colnum) {
+      std::ostringstream name;
+      name << root << colnum;
+      return name.str();
+   }
+
+   double readKeyOrDefault(fitsfile * fptr, const std::string & keyname,
+                           double defaultValue, const std::string & routine) {
+      int status(0);
+      double value(defaultValue);
+      fits_read_key(fptr, TDOUBLE, const_cast<char *>(keyname.c_str()),
+                    &value, 0, &status);
+      if (status == KEY_NO_EXIST) {
+         return defaultValue;
+      }
+      checkStatus(status, routine, fptr);
+      return value;
+   }
+
+   /// Find the layouts of the named columns and the row width, NAXIS1.
+   /// The raw rows of ASCII tables are not decoded, so for those the
+   /// row width is zero and all columns are read with fits_read_col.
+   void getColumnLayouts(fitsfile * fptr,
+                         const std::vector<std::string> & columnNames,
+                         const std::string & routine,
+                         std::vector<ColumnLayout> & layouts,
+                         size_t & rowBytes, size_t & nrows) {
+      int status(0);
+      int hdutype(0);
+      fits_get_hdu_type(fptr, &hdutype, &status);
+      checkStatus(status, routine, fptr);
+      bool binary(hdutype == BINARY_TBL);
+
+      int ncols(0);
+      fits_get_num_cols(fptr, &ncols, &status);
+      checkStatus(status, routine, fptr);
+      std::vector<size_t> offsets(ncols + 1, 0);
+      std::vector<char> codes(ncols + 1, 0);
+      rowBytes = 0;
+      if (binary) {
+         for (int col(1); col <= ncols; col++) {
+            std::string keyname(keyName("TFORM", col));
+            char tform[FLEN_VALUE];
+            fits_read_key_str(fptr, const_cast<char *>(keyname.c_str()),
+                              tform, 0, &status);
+            checkStatus(status, routine, fptr);
+            size_t repeat;
+            offsets[col] = offsets[col-1] + tformBytes(tform, repeat,
+                                                       codes[col]);
+         }
+         LONGLONG naxis1(0);
+         fits_read_key(fptr, TLONGLONG, const_cast<char *>("NAXIS1"), &naxis1,
+                       0, &status);
+         checkStatus(status, routine, fptr);
+         rowBytes = naxis1;
+         if (offsets[ncols] != rowBytes) {
+            int close_status(0);
+            fits_close_file(fptr, &close_status);
+            throw std::runtime_error("FitsUtil::" + routine + ":\n column "
+                                     "formats are inconsistent with NAXIS1.");
+         }
+      }
+
+      layouts.resize(columnNames.size());
+      for (size_t k(0); k < columnNames.size(); k++) {
+         ColumnLayout & layout(layouts[k]);
+         getColumnInfo(fptr, columnNames[k], routine, layout.colnum,
+                       layout.repeat, nrows);
+         layout.offset = offsets[layout.colnum - 1];
+         layout.code = codes[layout.colnum];
+         if (layout.code == 0 || std::strchr("BIJKED", layout.code) == 0) {
+            layout.code = 0;
+         }
+         layout.scale = readKeyOrDefault(fptr, keyName("TSCAL", layout.colnum),
+                                         1, routine);
+         layout.zero = readKeyOrDefault(fptr, keyName("TZERO", layout.colnum),
+                                        0, routine);
+      }
+   }
+
+   bool hostIsLittleEndian() {
+      unsigned short one(1);
+      unsigned char first;
+      std::memcpy(&first, &one, 1);
+      return first == 1;
+   }
+
+   const bool s_littleEndian(hostIsLittleEndian());
+
+   template <typename T>
+   T fromBigEndian(const unsigned char * bytes) {
+      unsigned char swapped[sizeof(T)];
+      if (s_littleEndian) {
+         for (size_t i(0); i < sizeof(T); i++) {
+            swapped[i] = bytes[sizeof(T) - 1 - i];
+         }
+         bytes = swapped;
+      }
+      T value;
+      std::memcpy(&value, bytes, sizeof(T));
+      return value;
+   }
+
+   /// Decode rows [begin, end) of a column from a block of raw rows
+   /// into values, which holds repeat elements per row.
+   template <typename T>
+   void decodeRows(const ColumnLayout & layout, const unsigned char * rows,
+                   size_t rowBytes, size_t begin, size_t end,
+                   double * values) {
+      for (size_t row(begin); row < end; row++) {
+         const unsigned char * bytes(rows + row*rowBytes + layout.offset);
+         double * dest(values + row*layout.repeat);
+         for (size_t j(0); j < layout.repeat; j++, bytes += sizeof(T)) {
+            dest[j] = layout.scale*fromBigEndian<T>(bytes) + layout.zero;
+         }
+      }
+   }
+
+   void decodeColumn(const ColumnLayout & layout, const unsigned char * rows,
+                     size_t rowBytes, size_t begin, size_t end,
+                     double * values) {
+      switch (layout.code) {
+      case 'B':
+         decodeRows<unsigned char>(layout, rows, rowBytes, begin, end, values);
+         break;
+      case 'I':
+         decodeRows<short>(layout, rows, rowBytes, begin, end, values);
+         break;
+      case 'J':
+         decodeRows<int>(layout, rows, rowBytes, begin, end, values);
+         break;
+      case 'K':
+         decodeRows<long long>(layout, rows, rowBytes, begin, end, values);
+         break;
+      case 'E':
+         decodeRows<float>(layout, rows, rowBytes, begin, end, values);
+         break;
+      case 'D':
+         decodeRows<double>(layout, rows, rowBytes, begin, end, values);
+         break;
+      }
+   }
+
+   /// Raw rows are read in blocks of at least this many bytes so that
+   /// decoding threads have enough work per block.
+   const size_t s_blockBytes(4*1024*1024);
+
+   /// Minimum number of rows per decoding thread.
+   const size_t s_minDecodeRows(1024);
+
+   /// All rows of the table if rows is null, otherwise the given
+   /// ranges, which are checked against the number of rows.
+   FitsUtil::RowRanges selectedRows(fitsfile * fptr, 
+                                    const FitsUtil::RowRanges * rows,
+                                    size_t nrows, const std::string & routine,
+                                    size_t & nselected) {
+      FitsUtil::RowRanges ranges;
+      if (rows == 0) {
+         ranges.push_back(std::make_pair(size_t(0), nrows));
+      } else {
+         ranges = *rows;
+      }
+      nselected = 0;
+      for (size_t i(0); i < ranges.size(); i++) {
+         if (ranges[i].first > ranges[i].second || ranges[i].second > nrows) {
+            int status(0);
+            fits_close_file(fptr, &status);
+            throw std::out_of_range("FitsUtil::" + routine + ":\n invalid "
+                                    "row range.");
+         }
+         nselected += ranges[i].second - ranges[i].first;
+      }
+      return ranges;
+   }
+
+   void readTableVector(const std::string & filename,
+                        const std::string & extName,
+                        const std::string & columnName,
+                        const FitsUtil::RowRanges * rows,
+                        std::vector<double> & branchVector) {
+      std::string routine("getTableVector");
+      fitsfile * fptr(openTable(filename, extName, routine));
+      int colnum;
+      size_t repeat, nrows, nselected;
+      getColumnInfo(fptr, columnName, routine, colnum, repeat, nrows);
+      FitsUtil::RowRanges ranges(selectedRows(fptr, rows, nrows, routine,
+                                              nselected));
+      size_t chunkRows(getChunkRows(fptr, 0, routine));
+
+      branchVector.resize(nselected*repeat);
+      size_t row(0);
+      for (size_t i(0); i < ranges.size(); i++) {
+         size_t last(ranges[i].second);
+         for (size_t first(ranges[i].first); first < last; first += chunkRows) {
+            size_t nread(std::min(chunkRows, last - first));
+            readRows(fptr, colnum, repeat, first, nread, 
+                     &branchVector[row*repeat], routine);
+            row += nread;
+         }
+      }
+
+      int status(0);
+      fits_close_file(fptr, &status);
+      checkStatus(status, routine);
+   }
+
+   void readTableColumns(const std::string & filename,
+                         const std::string & extName,
+                         const std::vector<std::string> & columnNames,
+                         const FitsUtil::RowRanges * rows,
+                         std::vector< std::vector<double> > & columns,
+                         std::vector<size_t> * repeats,
+                         size_t nthreads) {
+      std::string routine("getTableColumns");
+      fitsfile * fptr(openTable(filename, extName, routine));
+      std::vector<ColumnLayout> layouts;
+      size_t rowBytes(0);
+      size_t nrows(0);
+      getColumnLayouts(fptr, columnNames, routine, layouts, rowBytes, nrows);
+      if (repeats) {
+         repeats->resize(layouts.size());
+         for (size_t k(0); k < layouts.size(); k++) {
+            (*repeats)[k] = layouts[k].repeat;
+         }
+      }
+      size_t nselected;
+      FitsUtil::RowRanges ranges(selectedRows(fptr, rows, nrows, routine,
+                                              nselected));
+
+      columns.resize(columnNames.size());
+      for (size_t k(0); k < columns.size(); k++) {
+         columns[k].resize(nselected*layouts[k].repeat);
+      }
+      size_t chunkRows(std::max(getChunkRows(fptr, 0, routine),
+                                s_blockBytes/std::max(rowBytes, size_t(1))));
+      chunkRows = std::min(chunkRows, nrows);
+      std::vector<unsigned char> raw(chunkRows*rowBytes);
+
+      size_t row(0);
+      for (size_t i(0); i < ranges.size(); i++) {
+         size_t last(ranges[i].second);
+         for (size_t first(ranges[i].first); first < last; first += chunkRows) {
+            size_t nread(std::min(chunkRows, last - first));
+            if (rowBytes > 0) {
+               int status(0);
+               fits_read_tblbytes(fptr, first + 1, 1, nread*rowBytes, &raw[0],
+                                  &status);
+               checkStatus(status, routine, fptr);
+            }
+            Parallel::forChunks(nread, nthreads, s_minDecodeRows,
+                                [&](size_t begin, size_t end) {
+               for (size_t k(0); k < layouts.size(); k++) {
+                  if (layouts[k].code != 0 && layouts[k].repeat > 0) {
+                     decodeColumn(layouts[k], &raw[0], rowBytes, begin, end,
+                                  &columns[k][row*layouts[k].repeat]);
+                  }
+               }
+            });
+            for (size_t k(0); k < layouts.size(); k++) {
+               if (layouts[k].code == 0) {
+                  readRows(fptr, layouts[k].colnum, layouts[k].repeat, first,
+                           nread, &columns[k][row*layouts[k].repeat], routine);
+               }
+            }
+            row += nread;
+         }
+      }
+
+      int status(0);
+      fits_close_file(fptr, &status);
+      checkStatus(status, routine);
+   }
+
+   /// Value of a scalar column in the zero-based row.
+   double readValue(fitsfile * fptr, int colnum, size_t row,
+                    const std::string & routine) {
+      double value(0);
+      readRows(fptr, colnum, 1, row, 1, &value, routine);
+      return value;
+   }
+
+   /// Sort ranges and merge those that overlap or abut.
+   void mergeRanges(FitsUtil::RowRanges & ranges) {
+      std::sort(ranges.begin(), ranges.end());
+      FitsUtil::RowRanges merged;
+      for (size_t i(0); i < ranges.size(); i++) {
+         if (ranges[i].first == ranges[i].second) {
+            continue;
+         }
+         if (!merged.empty() && ranges[i].first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second,
+                                            ranges[i].second);
+         } else {
+            merged.push_back(ranges[i]);
+         }
+      }
+      ranges.swap(merged);
+   }
+
+   /// Read the cell of a column in the zero-based row.
+   void readCell(fitsfile * fptr, int colnum, size_t repeat, bool variable,
+                 size_t row, std::vector<double> & values,
+                 const std::string & routine) {
+      if (variable) {
+         int status(0);
+         LONGLONG length(0), heapaddr(0);
+         fits_read_descriptll(fptr, colnum, row + 1, &length, &heapaddr,
+                              &status);
+         checkStatus(status, routine, fptr);
+         repeat = length;
+      }
+      values.resize(repeat);
+      readRows(fptr, colnum, repeat, row, 1, 
+               values.empty() ? 0 : &values[0], routine);
+   }
+
+   /// Ones' complement sum of two 32-bit checksums.
+   unsigned long addChecksums(unsigned long a, unsigned long b) {
+      unsigned long long sum(static_cast<unsigned long long>(a) + b);
+      return static_cast<unsigned long>((sum & 0xffffffffULL) + (sum >> 32));
+   }
+
+   /// Ones' complement sum of the big-endian 32-bit words of bytes.
+   unsigned long checksumBytes(const unsigned char * bytes, size_t nbytes) {
+      unsigned long long sum(0);
+      for (size_t i(0); i + 3 < nbytes; i += 4) {
+         sum += (static_cast<unsigned long>(bytes[i]) << 24)
+            | (static_cast<unsigned long>(bytes[i+1]) << 16)
+            | (static_cast<unsigned long>(bytes[i+2]) << 8) | bytes[i+3];
+      }
+      while (sum >> 32) {
+         sum = (sum & 0xffffffffULL) + (sum >> 32);
+      }
+      return static_cast<unsigned long>(sum);
+   }
+
+   /// Size of a FITS logical record in bytes.
+   const size_t s_fitsRecord(2880);
+
+   /// Number of records read at a time when computing checksums.
+   const size_t s_checksumRecords(256);
+
+   /// Minimum number of records per checksum thread.
+   const size_t s_minChecksumRecords(1024);
+
+   /// Open a file for reading its bytes directly, or return -1 if it
+   /// is not a plain FITS file, e.g., if it is compressed.
+   int openRawFits(const std::string & filename) {
+#ifdef WIN32
+      return -1;
+#else
+      int fd(::open(filename.c_str(), O_RDONLY));
+      if (fd < 0) {
+         return -1;
+      }
+      char magic[6];
+      if (::pread(fd, magic, sizeof(magic), 0) != sizeof(magic)
+          || std::strncmp(magic, "SIMPLE", sizeof(magic)) != 0) {
+         ::close(fd);
+         return -1;
+      }
+      return fd;
+#endif
+   }
+
+   void closeRawFits(int fd) {
+#ifndef WIN32
+      if (fd >= 0) {
+         ::close(fd);
+      }
+#endif
+   }
+
+   void readBytes(int fd, LONGLONG offset, size_t nbytes,
+                  unsigned char * bytes) {
+#ifdef WIN32
+      throw std::runtime_error("FitsUtil::writeChecksums:\n "
+                               "error reading file.");
+#else
+      while (nbytes > 0) {
+         ssize_t nread(::pread(fd, bytes, nbytes, offset));
+         if (nread <= 0) {
+            throw std::runtime_error("FitsUtil::writeChecksums:\n "
+                                     "error reading file.");
+         }
+         bytes += nread;
+         offset += nread;
+         nbytes -= nread;
+      }
+#endif
+   }
+
+   /// Checksum of bytes [start, stop) of the file fd, computed on up
+   /// to nthreads threads.  start must lie on a 32-bit word boundary of
+   /// the HDU and the first skipBytes bytes are counted as zeros.  The
+   /// file fptr is closed if the bytes cannot be read.
+   unsigned long fileChecksum(fitsfile * fptr, int fd, LONGLONG start,
+                              LONGLONG stop, size_t nthreads,
+                              size_t skipBytes=0) {
+      size_t nrec((stop - start + s_fitsRecord - 1)/s_fitsRecord);
+      unsigned long total(0);
+      std::mutex total_mutex;
+      try {
+         Parallel::forChunks(nrec, nthreads, s_minChecksumRecords,
+                             [&](size_t begin, size_t end) {
+            std::vector<unsigned char> buffer(s_checksumRecords*s_fitsRecord);
+            unsigned long sum(0);
+            for (size_t rec(begin); rec < end; rec += s_checksumRecords) {
+               LONGLONG offset(start + rec*s_fitsRecord);
+               size_t nbytes(std::min<LONGLONG>(std::min(s_checksumRecords,
+                                                         end - rec)
+                                                *s_fitsRecord,
+                                                stop - offset));
+               readBytes(fd, offset, nbytes, &buffer[0]);
+               if (rec == 0) {
+                  std::fill(buffer.begin(), buffer.begin()
+                            + std::min(skipBytes, nbytes), 0);
+               }
+               sum = addChecksums(sum, checksumBytes(&buffer[0], nbytes));
+            }
+            std::lock_guard<std::mutex> lock(total_mutex);
+            total = addChecksums(total, sum);
+         });
+      } catch (...) {
+         int status(0);
+         fits_close_file(fptr, &status);
+         throw;
+      }
+      return total;
+   }
+
+   /// Write DATASUM and CHECKSUM for the current HDU, as
+   /// fits_write_chksum does, but computing the data checksum from the
+   /// file on up to nthreads threads.  Only the data from byte
+   /// firstByte of the data unit onwards are read; priorSum is the
+   /// checksum of the preceding bytes, with any bytes from firstByte
+   /// onwards in their last 32-bit word taken as zeros.
+   void writeHduChecksum(fitsfile * fptr, int fd, size_t nthreads,
+                         const std::string & routine,
+                         LONGLONG firstByte=0, unsigned long priorSum=0) {
+      int status(0);
+      char date[FLEN_VALUE];
+      int timeref;
+      fits_get_system_time(date, &timeref, &status);
+      std::string hduComment(std::string("HDU checksum updated ") + date);
+      std::string dataComment(std::string("data unit checksum updated ") 
+                              + date);
+// Write the keywords before locating the data, since adding them may
+// enlarge the header.  Flushing writes the header, with its END card
+// and fill, to the file.
+      fits_update_key_str(fptr, "CHECKSUM", "0000000000000000",
+                          hduComment.c_str(), &status);
+      fits_update_key_str(fptr, "DATASUM", "0", dataComment.c_str(), &status);
+      fits_flush_file(fptr, &status);
+      LONGLONG headstart, datastart, dataend;
+      fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status);
+      checkStatus(status, routine, fptr);
+
+      if (datastart + firstByte > dataend) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+         throw std::out_of_range("FitsUtil::" + routine + ":\n first byte "
+                                 "is beyond the end of the data.");
+      }
+      size_t skipBytes(firstByte % 4);
+      unsigned long datasum(addChecksums(priorSum,
+                                         fileChecksum(fptr, fd, datastart
+                                                      + firstByte - skipBytes,
+                                                      dataend, nthreads,
+                                                      skipBytes)));
+      std::ostringstream value;
+      value << datasum;
+      fits_update_key_str(fptr, "DATASUM", value.str().c_str(), "&", &status);
+      fits_flush_file(fptr, &status);
+      checkStatus(status, routine, fptr);
+
+      unsigned long sum(addChecksums(fileChecksum(fptr, fd, headstart,
+                                                  datastart, 1), datasum));
+      char checksum[FLEN_VALUE];
+      fits_encode_chksum(sum, TRUE, checksum);
+      fits_update_key_str(fptr, "CHECKSUM", checksum, "&", &status);
+      checkStatus(status, routine, fptr);
+   }
+
+   /// Closes the files it holds when destroyed, e.g., when an
+   /// exception is thrown.
+   class FitsFiles {
+   public:
+      ~FitsFiles() {
+         for (size_t i(0); i < m_files.size(); i++) {
+            int status(0);
+            fits_close_file(m_files[i], &status);
+         }
+      }
+      fitsfile * add(fitsfile * fptr) {
+         m_files.push_back(fptr);
+         return fptr;
+      }
+      /// Close the files, reporting any error.
+      void close(const std::string & routine) {
+         int status(0);
+         while (!m_files.empty()) {
+            fits_close_file(m_files.back(), &status);
+            m_files.pop_back();
+         }
+         checkStatus(status, routine);
+      }
+   private:
+      std::vector<fitsfile *> m_files;
+   };
+
+   /// Number of rows for which each thread evaluates the filter in
+   /// each block copied by filterCopy.
+   const size_t s_filterRows(65536);
+
+   /// @return true if a row filter refers to row numbers or, through
+   ///         gtifilter with no file name, to the GTI extension of the
+   ///         table's own file.  Such a filter cannot be evaluated on a
+   ///         copy of some of the rows of the table.
+   bool filterNeedsTable(const std::string & filterString) {
+      std::string filter(filterString);
+      for (size_t i(0); i < filter.size(); i++) {
+         filter[i] = std::toupper(filter[i]);
+      }
+      if (filter.find("#ROW") != std::string::npos) {
+         return true;
+      }
+      const std::string gtifilter("GTIFILTER");
+      for (size_t pos(filter.find(gtifilter)); pos != std::string::npos;
+           pos = filter.find(gtifilter, pos + 1)) {
+         size_t arg(filter.find_first_not_of(" \t",
+                                             pos + gtifilter.size()));
+         if (arg == std::string::npos || filter[arg] != '(') {
+            continue;
+         }
+         arg = filter.find_first_not_of(" \t", arg + 1);
+         if (arg == std::string::npos || filter[arg] == ')' 
+             || filter[arg] == ',') {
+            return true;
+         }
+         if ((filter[arg] == '"' || filter[arg] == '\'')
+             && arg + 1 < filter.size() && filter[arg + 1] == filter[arg]) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /// Create an in-memory file holding an empty primary HDU and a
+   /// table with the header of the current HDU of infile and nrows
+   /// rows, on which filterCopy evaluates the filter.
+   fitsfile * createMemTable(fitsfile * infile, size_t nrows,
+                             const std::string & routine) {
+      int status(0);
+      fitsfile * memfile(0);
+      fits_create_file(&memfile, const_cast<char *>("mem://"), &status);
+      checkStatus(status, routine);
+      fits_create_img(memfile, BYTE_IMG, 0, 0, &status);
+      fits_copy_header(infile, memfile, &status);
+      fits_modify_key_lng(memfile, "NAXIS2", 0, "&", &status);
+      fits_set_hdustruc(memfile, &status);
+      fits_insert_rows(memfile, 0, nrows, &status);
+      checkStatus(status, routine, memfile);
+      return memfile;
+   }
+
+   /// Number of rows tested by each call to fits_find_rows.
+   const size_t s_findRowsBlock(1024*1024);
+}
+
+void FitsUtil::getTableVector(const std::string & filename,
+                              const std::string & extName,
+                              const std::string & columnName, 
+                              std::vector<double> & branchVector) {
+   readTableVector(filename, extName, columnName, 0, branchVector);
+}
+
 void FitsUtil::getTableVector(const std::string & filename,
                               const std::string & extName,
                               const std::string & columnName, 
+                              const RowRanges & rows,
                               std::vector<double> & branchVector) {
-   const tip::Table * my_tree 
-      = tip::IFileSvc::instance().readTable(filename, extName);
-   tip::Table::ConstIterator it = my_tree->begin();
-   tip::ConstTableRecord & row = *it;
-   int nrows = my_tree->getNumRecords();
-   branchVector.resize(nrows);
-   for (int i = 0; it != my_tree->end() && i < nrows; ++it, ++i) {
-      row[columnName].get(branchVector[i]);
+   readTableVector(filename, extName, columnName, &rows, branchVector);
+}
+
+void FitsUtil::findRows(const std::string & filename,
+                        const std::string & extName,
+                        const std::string & filterString,
+                        RowRanges & rows) {
+   std::string routine("findRows");
+   fitsfile * fptr(openTable(filename, extName, routine));
+   int status(0);
+   LONGLONG numRows(0);
+   fits_get_num_rowsll(fptr, &numRows, &status);
+   checkStatus(status, routine, fptr);
+   size_t nrows(numRows);
+
+   rows.clear();
+   std::vector<char> rowStatus(std::min(nrows, s_findRowsBlock));
+   for (size_t first(0); first < nrows; first += rowStatus.size()) {
+      size_t ntest(std::min(rowStatus.size(), nrows - first));
+      long ngood(0);
+      fits_find_rows(fptr, const_cast<char *>(filterString.c_str()),
+                     first + 1, ntest, &ngood, &rowStatus[0], &status);
+      checkStatus(status, routine, fptr);
+      for (size_t i(0); i < ntest; i++) {
+         if (!rowStatus[i]) {
+            continue;
+         }
+         size_t row(first + i);
+         if (!rows.empty() && rows.back().second == row) {
+            rows.back().second++;
+         } else {
+            rows.push_back(std::make_pair(row, row + 1));
+         }
+      }
    }
-   delete my_tree;
+
+   fits_close_file(fptr, &status);
+   checkStatus(status, routine);
+}
+
+void FitsUtil::findSortedRows(const std::string & filename,
+                              const std::string & extName,
+                              const std::string & columnName,
+                              const std::vector< std::pair<double, double> >
+                              & intervals,
+                              RowRanges & rows) {
+   std::string routine("findSortedRows");
+   fitsfile * fptr(openTable(filename, extName, routine));
+   int colnum;
+   size_t repeat, nrows;
+   getColumnInfo(fptr, columnName, routine, colnum, repeat, nrows);
+   if (repeat != 1) {
+      int status(0);
+      fits_close_file(fptr, &status);
+      throw std::runtime_error("FitsUtil::findSortedRows:\n column "
+                               + columnName + " is not a scalar column.");
+   }
+
+   rows.clear();
+   for (size_t i(0); i < intervals.size(); i++) {
+// The first row with a value >= start and the first row with a
+// value > stop bracket the rows in the interval.
+      size_t lo(0), hi(nrows);
+      while (lo < hi) {
+         size_t mid(lo + (hi - lo)/2);
+         if (readValue(fptr, colnum, mid, routine) < intervals[i].first) {
+            lo = mid + 1;
+         } else {
+            hi = mid;
+         }
+      }
+      size_t begin(lo);
+      hi = nrows;
+      while (lo < hi) {
+         size_t mid(lo + (hi - lo)/2);
+         if (readValue(fptr, colnum, mid, routine) <= intervals[i].second) {
+            lo = mid + 1;
+         } else {
+            hi = mid;
+         }
+      }
+      rows.push_back(std::make_pair(begin, lo));
+   }
+   mergeRanges(rows);
+
+   int status(0);
+   fits_close_file(fptr, &status);
+   checkStatus(status, routine);
+}
+
+void FitsUtil::readColumnChunks(const std::string & filename,
+                                const std::string & extName,
+                                const std::string & columnName,
+                                const ColumnChunkCallback & callback,
+                                size_t chunkRows) {
+   std::string routine("readColumnChunks");
+   fitsfile * fptr(openTable(filename, extName, routine));
+   int colnum;
+   size_t repeat, nrows;
+   getColumnInfo(fptr, columnName, routine, colnum, repeat, nrows);
+   chunkRows = getChunkRows(fptr, chunkRows, routine);
+
+   std::vector<double> buffer(std::min(chunkRows, nrows)*repeat);
+   for (size_t first(0); first < nrows; first += chunkRows) {
+      size_t nread(std::min(chunkRows, nrows - first));
+      readRows(fptr, colnum, repeat, first, nread, 
+               buffer.empty() ? 0 : &buffer[0], routine);
+      try {
+         callback(first, nread, repeat, buffer.empty() ? 0 : &buffer[0]);
+      } catch (...) {
+         int status(0);
+         fits_close_file(fptr, &status);
+         throw;
+      }
+   }
+
+   int status(0);
+   fits_close_file(fptr, &status);
+   checkStatus(status, routine);
+}
+
+void FitsUtil::getTableColumns(const std::string & filename,
+                               const std::string & extName,
+                               const std::vector<std::string> & columnNames,
+                               std::vector< std::vector<double> > & columns,
+                               size_t nthreads) {
+   readTableColumns(filename, extName, columnNames, 0, columns, 0, nthreads);
+}
+
+void FitsUtil::getTableColumns(const std::string & filename,
+                               const std::string & extName,
+                               const std::vector<std::string> & columnNames,
+                               std::vector< std::vector<double> > & columns,
+                               std::vector<size_t> & repeats,
+                               size_t nthreads) {
+   readTableColumns(filename, extName, columnNames, 0, columns, &repeats,
+                    nthreads);
+}
+
+void FitsUtil::getTableColumns(const std::string & filename,
+                               const std::string & extName,
+                               const std::vector<std::string> & columnNames,
+                               const RowRanges & rows,
+                               std::vector< std::vector<double> > & columns,
+                               size_t nthreads) {
+   readTableColumns(filename, extName, columnNames, &rows, columns, 0,
+                    nthreads);
 }
 
 void FitsUtil::getRecordVector(const std::string & filename,
@@ -48,12 +901,44 @@ void FitsUtil::getRecordVector(const std::string & filename,
                                const std::string & columnName,
                                std::vector<double> & tableVector,
                                int recordNum) {
-   const tip::Table * my_table 
-      = tip::IFileSvc::instance().readTable(filename, extName);
-   tip::Table::ConstIterator it = my_table->begin();
-   for (int i = 0; i < recordNum && my_table->end() != it; ++i, ++it);
-   (*it)[columnName].get(tableVector);
-   delete my_table;
+   if (recordNum < 0) {
+      throw std::out_of_range("FitsUtil::getRecordVector:\n invalid "
+                              "record number.");
+   }
+   std::vector<size_t> recordNums(1, recordNum);
+   std::vector< std::vector<double> > tableVectors;
+   getRecordVectors(filename, extName, columnName, recordNums, tableVectors);
+   tableVector.swap(tableVectors.front());
+}
+
+void FitsUtil::getRecordVectors(const std::string & filename,
+                                const std::string & extName,
+                                const std::string & columnName,
+                                const std::vector<size_t> & recordNums,
+                                std::vector< std::vector<double> > 
+                                & tableVectors) {
+   std::string routine("getRecordVectors");
+   fitsfile * fptr(openTable(filename, extName, routine));
+   int colnum;
+   size_t repeat, nrows;
+   bool variable;
+   getColumnInfo(fptr, columnName, routine, colnum, repeat, nrows, &variable);
+
+   tableVectors.resize(recordNums.size());
+   for (size_t i(0); i < recordNums.size(); i++) {
+      if (recordNums[i] >= nrows) {
+         int status(0);
+         fits_close_file(fptr, &status);
+         throw std::out_of_range("FitsUtil::" + routine + ":\n invalid "
+                                 "record number.");
+      }
+      readCell(fptr, colnum, repeat, variable, recordNums[i],
+               tableVectors[i], routine);
+   }
+
+   int status(0);
+   fits_close_file(fptr, &status);
+   checkStatus(status, routine);
 }
 
 void FitsUtil::getFitsHduName(const std::string &filename, int hdu,
@@ -100,53 +985,120 @@ void FitsUtil::getFitsColNames(const std::string & filename, int hdu,
    delete my_table;
 }
 
-void FitsUtil::writeChecksums(const std::string & filename) {
-// Use tip to ascertain the number of HDUs
-   tip::FileSummary summary;
-   tip::IFileSvc::instance().getFileSummary(filename, summary);
-   unsigned int nhdus = summary.size();
-
+void FitsUtil::writeChecksums(const std::string & filename,
+                              size_t nthreads) {
+   std::string routine("writeChecksums");
    int status(0);
-   fitsfile * fptr = 0;
-
+   fitsfile * fptr(0);
    fits_open_file(&fptr, filename.c_str(), READWRITE, &status);
-   if (status != 0) {
-      fits_report_error(stderr, status);
-      throw std::runtime_error("FitsUtil::writeChecksums: cfitsio error.");
-   }
+   checkStatus(status, routine);
 
+// FILENAME is written first so that the primary HDU checksum
+// includes it.
+   int nhdus(0);
    int hdutype(0);
-   for (unsigned int hdu = 1; hdu < nhdus+1; hdu++) {
+   fits_get_num_hdus(fptr, &nhdus, &status);
+   fits_movabs_hdu(fptr, 1, &hdutype, &status);
+   fits_update_key_str(fptr, "FILENAME", 
+                       facilities::Util::basename(filename).c_str(), 0,
+                       &status);
+   checkStatus(status, routine, fptr);
+
+   int fd(openRawFits(filename));
+   for (int hdu(1); hdu <= nhdus; hdu++) {
       fits_movabs_hdu(fptr, hdu, &hdutype, &status);
-      if (status != 0) {
-         fits_report_error(stderr, status);
-         throw 
-            std::runtime_error("FitsUtil::writeChecksums: cfitsio error.");
+      if (fd < 0) {
+         fits_write_chksum(fptr, &status);
       }
-      
-      fits_write_chksum(fptr, &status);
       if (status != 0) {
-         fits_report_error(stderr, status);
-         throw 
-            std::runtime_error("FitsUtil::writeChecksums: cfitsio error.");
+         closeRawFits(fd);
+         checkStatus(status, routine, fptr);
+      }
+      if (fd >= 0) {
+         try {
+            writeHduChecksum(fptr, fd, nthreads, routine);
+         } catch (...) {
+            closeRawFits(fd);
+            throw;
+         }
       }
    }
+   closeRawFits(fd);
 
    fits_close_file(fptr, &status);
-   if (status != 0) {
-      fits_report_error(stderr, status);
-      throw std::runtime_error("FitsUtil::writeChecksums: cfitsio error.");
+   checkStatus(status, routine);
+}
+
+void FitsUtil::updateChecksums(const std::string & filename,
+                               const std::string & extName,
+                               size_t firstNewRow, size_t nthreads) {
+   std::string routine("updateChecksums");
+   fitsfile * fptr(openTable(filename, extName, routine, READWRITE));
+   int status(0);
+   int hdutype(0);
+   LONGLONG naxis1(0), naxis2(0), pcount(0);
+   fits_get_hdu_type(fptr, &hdutype, &status);
+   fits_read_key(fptr, TLONGLONG, const_cast<char *>("NAXIS1"), &naxis1,
+                 0, &status);
+   fits_read_key(fptr, TLONGLONG, const_cast<char *>("NAXIS2"), &naxis2,
+                 0, &status);
+   fits_read_key(fptr, TLONGLONG, const_cast<char *>("PCOUNT"), &pcount,
+                 0, &status);
+   checkStatus(status, routine, fptr);
+   if (firstNewRow > static_cast<size_t>(naxis2)) {
+      fits_close_file(fptr, &status);
+      throw std::out_of_range("FitsUtil::updateChecksums:\n first new row "
+                              "is beyond the end of the table.");
+   }
+
+// The prior DATASUM can be reused only if the rows before firstNewRow
+// are unchanged, which is not the case if the table has a heap.
+   char datasum[FLEN_VALUE];
+   fits_read_key_str(fptr, const_cast<char *>("DATASUM"), datasum, 0,
+                     &status);
+   bool incremental(status == 0 && hdutype == BINARY_TBL && pcount == 0);
+   if (status == KEY_NO_EXIST) {
+      status = 0;
+   }
+   checkStatus(status, routine, fptr);
+
+   int fd(openRawFits(filename));
+   if (fd < 0) {
+      fits_write_chksum(fptr, &status);
+      checkStatus(status, routine, fptr);
+   } else {
+      try {
+         if (incremental) {
+            writeHduChecksum(fptr, fd, nthreads, routine, 
+                             firstNewRow*naxis1,
+                             std::strtoul(datasum, 0, 10));
+         } else {
+            writeHduChecksum(fptr, fd, nthreads, routine);
+         }
+      } catch (...) {
+         closeRawFits(fd);
+         throw;
+      }
+      closeRawFits(fd);
    }
 
-   writeFilename(filename);
+   fits_close_file(fptr, &status);
+   checkStatus(status, routine);
 }
 
 void FitsUtil::writeFilename(const std::string & filename) {
 // Write FILENAME keyword to primary HDU
-   tip::Extension * phdu 
-      = tip::IFileSvc::instance().editExtension(filename, "");
-   phdu->getHeader().setKeyword("FILENAME", facilities::Util::basename(filename));
-   delete phdu;
+   std::string routine("writeFilename");
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_file(&fptr, filename.c_str(), READWRITE, &status);
+   checkStatus(status, routine);
+   fits_update_key_str(fptr, "FILENAME", 
+                       facilities::Util::basename(filename).c_str(), 0,
+                       &status);
+   checkStatus(status, routine, fptr);
+   fits_close_file(fptr, &status);
+   checkStatus(status, routine);
 }
 
 void FitsUtil::fcopy(std::string infilename, 
@@ -201,4 +1153,156 @@ void FitsUtil::fcopy(std::string infilename,
    }
 }
 
+void FitsUtil::filterCopy(const std::string & infilename,
+                          const std::string & outfilename,
+                          const std::string & extname,
+                          const std::string & filterString,
+                          bool clobber,
+                          const ProgressCallback & progress,
+                          size_t nthreads) {
+   std::string routine("filterCopy");
+   if (extname == "" || filterString == "") {
+      fcopy(infilename, outfilename, extname, filterString, clobber);
+      return;
+   }
+   FitsFiles files;
+   fitsfile * infile(files.add(openTable(infilename, extname, routine)));
+   int status(0);
+   int hdutype(0);
+   LONGLONG naxis1(0), naxis2(0), pcount(0);
+   fits_get_hdu_type(infile, &hdutype, &status);
+   checkStatus(status, routine);
+   if (hdutype == BINARY_TBL) {
+      fits_read_key(infile, TLONGLONG, const_cast<char *>("NAXIS1"), &naxis1,
+                    0, &status);
+      fits_read_key(infile, TLONGLONG, const_cast<char *>("NAXIS2"), &naxis2,
+                    0, &status);
+      fits_read_key(infile, TLONGLONG, const_cast<char *>("PCOUNT"), &pcount,
+                    0, &status);
+      checkStatus(status, routine);
+   }
+// Copying raw rows would leave heap descriptors pointing into the
+// input heap.
+   if (hdutype != BINARY_TBL || pcount != 0
+       || filterNeedsTable(filterString)) {
+      files.close(routine);
+      fcopy(infilename, outfilename, extname, filterString, clobber);
+      return;
+   }
+   size_t rowBytes(naxis1);
+   size_t nrows(naxis2);
+   int target(0);
+   int nhdus(0);
+   fits_get_hdu_num(infile, &target);
+   fits_get_num_hdus(infile, &nhdus, &status);
+   checkStatus(status, routine);
+
+   fitsfile * outfile(0);
+   std::string outname(clobber ? "!" + outfilename : outfilename);
+   fits_create_file(&outfile, const_cast<char *>(outname.c_str()), &status);
+   checkStatus(status, routine);
+   files.add(outfile);
+
+// Copy the HDUs preceding the table, and the table's header with no
+// rows.
+   for (int hdu(1); hdu < target; hdu++) {
+      fits_movabs_hdu(infile, hdu, &hdutype, &status);
+      fits_copy_hdu(infile, outfile, 0, &status);
+   }
+   fits_movabs_hdu(infile, target, &hdutype, &status);
+   fits_copy_header(infile, outfile, &status);
+   fits_modify_key_lng(outfile, "NAXIS2", 0, "&", &status);
+   fits_set_hdustruc(outfile, &status);
+   checkStatus(status, routine);
+
+// Each block of rows is read from the file once.  Each thread copies
+// its share of the block to its own in-memory table and evaluates the
+// filter there, rather than reading the rows from the file again.
+   if (nthreads == 0) {
+      nthreads = Parallel::defaultThreads();
+   }
+   if (!fits_is_reentrant()) {
+      nthreads = 1;
+   }
+   std::vector<fitsfile *> memTables;
+   for (size_t i(0); i < nthreads; i++) {
+      memTables.push_back(files.add(createMemTable(infile,
+                                                   std::min(s_filterRows,
+                                                            nrows),
+                                                   routine)));
+   }
+
+   size_t blockRows(memTables.size()*s_filterRows);
+   std::vector<char> rowStatus(std::min(blockRows, nrows));
+   std::vector<unsigned char> raw(rowStatus.size()*rowBytes);
+   std::vector<int> statuses(memTables.size());
+   size_t nout(0);
+   std::chrono::steady_clock::time_point 
+      start(std::chrono::steady_clock::now());
+   for (size_t first(0); first < nrows; first += blockRows) {
+      size_t nblock(std::min(blockRows, nrows - first));
+      fits_read_tblbytes(infile, first + 1, 1, nblock*rowBytes, &raw[0],
+                         &status);
+      checkStatus(status, routine);
+
+      std::fill(statuses.begin(), statuses.end(), 0);
+      Parallel::forChunks(memTables.size(), memTables.size(), 1, 
+                          [&](size_t begin, size_t end) {
+         for (size_t i(begin); i < end; i++) {
+            size_t lo(i*nblock/memTables.size());
+            size_t hi((i + 1)*nblock/memTables.size());
+            long ngood(0);
+            if (hi > lo) {
+               fits_write_tblbytes(memTables[i], 1, 1, (hi - lo)*rowBytes,
+                                   &raw[lo*rowBytes], &statuses[i]);
+               fits_find_rows(memTables[i],
+                              const_cast<char *>(filterString.c_str()),
+                              1, hi - lo, &ngood, &rowStatus[lo],
+                              &statuses[i]);
+            }
+         }
+      });
+      for (size_t i(0); i < statuses.size(); i++) {
+         checkStatus(statuses[i], routine);
+      }
+
+// Gather the selected rows at the front of the block and append
+// them to the output table.
+      size_t nselected(0);
+      for (size_t i(0); i < nblock; i++) {
+         if (rowStatus[i]) {
+            if (nselected != i) {
+               std::memcpy(&raw[nselected*rowBytes], &raw[i*rowBytes],
+                           rowBytes);
+            }
+            nselected++;
+         }
+      }
+      if (nselected > 0) {
+         fits_insert_rows(outfile, nout, nselected, &status);
+         fits_write_tblbytes(outfile, nout + 1, 1, nselected*rowBytes,
+                             &raw[0], &status);
+         checkStatus(status, routine);
+         nout += nselected;
+      }
+
+      if (progress) {
+         std::chrono::duration<double> elapsed(std::chrono::steady_clock::now()
+                                               - start);
+         double rate(elapsed.count() > 0 ? (first + nblock)/elapsed.count()
+                     : 0);
+         progress(first + nblock, nrows, rate);
+      }
+   }
+
+// Copy the HDUs following the table.
+   for (int hdu(target + 1); hdu <= nhdus; hdu++) {
+      fits_movabs_hdu(infile, hdu, &hdutype, &status);
+      fits_copy_hdu(infile, outfile, 0, &status);
+   }
+   checkStatus(status, routine);
+
+   files.close(routine);
+}
+
 } // namespace st_facilities
@@ -0,0 +1,264 @@
+/**
+ * @file ImageView.cxx
+ * @brief Implementation for ImageView.
+ *
+ * $Header$
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include <limits>
+#include <stdexcept>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fitsio.h"
+
+#include "st_facilities/ImageView.h"
+
+namespace {
+   /// Unmaps a file when the last view of it is destroyed.
+   class Unmapper {
+   public:
+      Unmapper(size_t length) : m_length(length) {}
+      void operator()(const void * address) const {
+#ifndef WIN32
+         ::munmap(const_cast<void *>(address), m_length);
+#endif
+      }
+   private:
+      size_t m_length;
+   };
+
+   void checkStatus(int status, fitsfile * fptr) {
+      if (status == 0) {
+         return;
+      }
+      fits_report_error(stderr, status);
+      if (fptr) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+      }
+      throw std::runtime_error("ImageView::mapFits:\n cfitsio error.");
+   }
+
+// FITS data are big-endian; assembling the bytes explicitly is
+// independent of the host byte order.
+   unsigned long long bigEndian(const unsigned char * bytes, size_t n) {
+      unsigned long long value(0);
+      for (size_t i(0); i < n; i++) {
+         value = (value << 8) | bytes[i];
+      }
+      return value;
+   }
+}
+
+namespace st_facilities {
+
+ImageView::ImageView()
+   : m_data(0), m_size(0), m_stride(1), m_bitpix(-32), m_native(true),
+     m_bscale(1), m_bzero(0), m_hasBlank(false), m_blank(0) {}
+
+ImageView::ImageView(const float * data, size_t size)
+   : m_data(reinterpret_cast<const unsigned char *>(data)), m_size(size),
+     m_stride(1), m_bitpix(-32), m_native(true), m_bscale(1),
+     m_bzero(0), m_hasBlank(false), m_blank(0) {}
+
+ImageView::ImageView(const std::shared_ptr<const std::vector<float> > & data)
+   : m_owner(data), m_data(0), m_size(data->size()), m_stride(1),
+     m_bitpix(-32), m_native(true), m_bscale(1), m_bzero(0),
+     m_hasBlank(false), m_blank(0) {
+   if (!data->empty()) {
+      m_data = reinterpret_cast<const unsigned char *>(&(*data)[0]);
+   }
+}
+
+bool ImageView::mapFits(const std::string & filename,
+                        const std::string & extension,
+                        ImageView & view) {
+#ifdef WIN32
+   return false;
+#else
+// Only plain, uncompressed FITS files can be mapped.
+   struct stat info;
+   if (::stat(filename.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+      return false;
+   }
+
+   std::string hduname(filename);
+   if (extension != "") {
+      hduname += "[" + extension + "]";
+   }
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_file(&fptr, hduname.c_str(), READONLY, &status);
+   checkStatus(status, 0);
+
+   int hdutype(0);
+   fits_get_hdu_type(fptr, &hdutype, &status);
+   int compressed(fits_is_compressed_image(fptr, &status));
+   int bitpix(0);
+   int naxis(0);
+   LONGLONG naxes[9];
+   fits_get_img_paramll(fptr, 9, &bitpix, &naxis, naxes, &status);
+   checkStatus(status, fptr);
+
+   double bscale(1);
+   double bzero(0);
+   fits_read_key(fptr, TDOUBLE, "BSCALE", &bscale, 0, &status);
+   if (status == KEY_NO_EXIST) {
+      status = 0;
+      bscale = 1;
+   }
+   fits_read_key(fptr, TDOUBLE, "BZERO", &bzero, 0, &status);
+   if (status == KEY_NO_EXIST) {
+      status = 0;
+      bzero = 0;
+   }
+   bool hasBlank(false);
+   LONGLONG blank(0);
+   if (bitpix > 0) {
+      fits_read_key(fptr, TLONGLONG, "BLANK", &blank, 0, &status);
+      hasBlank = (status == 0);
+      if (status == KEY_NO_EXIST) {
+         status = 0;
+      }
+   }
+   LONGLONG headstart, datastart, dataend;
+   fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status);
+   checkStatus(status, fptr);
+   fits_close_file(fptr, &status);
+   checkStatus(status, 0);
+
+   size_t npix(naxis > 0 && naxis <= 9 ? 1 : 0);
+   for (int i(0); i < naxis && i < 9; i++) {
+      npix *= naxes[i];
+   }
+   size_t bytes((bitpix < 0 ? -bitpix : bitpix)/8);
+   if (hdutype != IMAGE_HDU || compressed
+       || static_cast<off_t>(datastart + npix*bytes) > info.st_size) {
+      return false;
+   }
+
+// cfitsio transparently decompresses gzip'd files, in which case the
+// HDU addresses do not refer to the bytes on disk.
+   int fd(::open(filename.c_str(), O_RDONLY));
+   if (fd < 0) {
+      return false;
+   }
+   char magic[6];
+   if (::read(fd, magic, sizeof(magic)) != sizeof(magic)
+       || std::strncmp(magic, "SIMPLE", sizeof(magic)) != 0) {
+      ::close(fd);
+      return false;
+   }
+   void * address(::mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0));
+   ::close(fd);
+   if (address == MAP_FAILED) {
+      return false;
+   }
+
+   view.m_owner = std::shared_ptr<const void>(address,
+                                              Unmapper(info.st_size));
+   view.m_data = static_cast<const unsigned char *>(address) + datastart;
+   view.m_size = npix;
+   view.m_stride = 1;
+   view.m_bitpix = bitpix;
+   view.m_native = false;
+   view.m_bscale = bscale;
+   view.m_bzero = bzero;
+   view.m_hasBlank = hasBlank;
+   view.m_blank = blank;
+   return true;
+#endif
+}
+
+double ImageView::decode(const unsigned char * pixel) const {
+   if (m_native) {
+      return *reinterpret_cast<const float *>(pixel);
+   }
+   long long integer(0);
+   double value(0);
+   switch (m_bitpix) {
+   case 8:
+      integer = pixel[0];
+      break;
+   case 16:
+      integer = static_cast<short>(bigEndian(pixel, 2));
+      break;
+   case 32:
+      integer = static_cast<int>(bigEndian(pixel, 4));
+      break;
+   case 64:
+      integer = static_cast<long long>(bigEndian(pixel, 8));
+      break;
+   case -32:
+      {
+         unsigned int bits(static_cast<unsigned int>(bigEndian(pixel, 4)));
+         float x;
+         std::memcpy(&x, &bits, sizeof(x));
+         value = x;
+      }
+      break;
+   case -64:
+      {
+         unsigned long long bits(bigEndian(pixel, 8));
+         std::memcpy(&value, &bits, sizeof(value));
+      }
+      break;
+   default:
+      throw std::runtime_error("ImageView: invalid BITPIX value");
+   }
+   if (m_bitpix > 0) {
+      if (m_hasBlank && integer == m_blank) {
+         return std::numeric_limits<float>::quiet_NaN();
+      }
+      value = static_cast<double>(integer);
+   }
+// Round as cfitsio does when reading the image as floats.
+   return static_cast<float>(m_bscale*value + m_bzero);
+}
+
+double ImageView::operator[](size_t indx) const {
+   return decode(m_data + indx*m_stride*bytesPerPixel());
+}
+
+void ImageView::get(size_t first, size_t n, double * values) const {
+   if (first + n > m_size) {
+      throw std::out_of_range("ImageView::get: pixel range exceeds "
+                              "the size of the view");
+   }
+   size_t step(m_stride*bytesPerPixel());
+   const unsigned char * pixel(m_data + first*step);
+   for (size_t i(0); i < n; i++, pixel += step) {
+      values[i] = decode(pixel);
+   }
+}
+
+void ImageView::get(std::vector<double> & values) const {
+   values.resize(m_size);
+   if (m_size > 0) {
+      get(0, m_size, &values[0]);
+   }
+}
+
+ImageView ImageView::subView(size_t first, size_t count,
+                             size_t stride) const {
+   if (stride == 0 || (count > 0 && first + (count - 1)*stride >= m_size)) {
+      throw std::out_of_range("ImageView::subView: pixel range exceeds "
+                              "the size of the view");
+   }
+   ImageView view(*this);
+   view.m_data = m_data + first*m_stride*bytesPerPixel();
+   view.m_size = count;
+   view.m_stride = m_stride*stride;
+   return view;
+}
+
+} // namespace st_facilities
@@ -0,0 +1,68 @@
+/**
+ * @file Interpolator1D.cxx
+ * @brief Implementation for Interpolator1D.
+ *
+ * $Header$
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "st_facilities/Interpolator1D.h"
+
+namespace st_facilities {
+
+Interpolator1D::Interpolator1D(const std::vector<double> & x,
+                               const std::vector<double> & y)
+   : m_x(x), m_y(y), m_index(0) {
+   if (m_x.size() < 2 || m_x.size() != m_y.size()) {
+      throw std::invalid_argument("Interpolator1D: x and y must have the "
+                                  "same size, with at least two points");
+   }
+}
+
+double Interpolator1D::operator()(double xx) {
+   if (!(xx >= m_x.front() && xx <= m_x.back())) {
+      std::ostringstream message;
+      message << "Interpolator1D:\n"
+              << "abscissa value out-of-range, "
+              << xx << " is not in ("
+              << m_x.front() << ", "
+              << m_x.back() << ")";
+      throw std::range_error(message.str());
+   }
+   if (xx == m_x.back()) {
+      return m_y.back();
+   }
+   m_index = hunt(m_x, xx, m_index);
+   return interpolate(m_x, m_y, m_index, xx);
+}
+
+size_t Interpolator1D::hunt(const std::vector<double> & x, double xx,
+                            size_t guess) {
+   size_t last(x.size() - 1);
+   size_t lo(std::min(guess, last - 1));
+   size_t hi(lo + 1);
+// Widen [lo, hi] in doubling steps until x[lo] <= xx < x[hi].  The
+// loops terminate since x.front() <= xx < x.back().
+   size_t step(1);
+   if (x[lo] <= xx) {
+      while (x[hi] <= xx) {
+         lo = hi;
+         step *= 2;
+         hi = std::min(lo + step, last);
+      }
+   } else {
+      hi = lo;
+      while (x[lo] > xx) {
+         hi = lo;
+         lo = lo > step ? lo - step : 0;
+         step *= 2;
+      }
+   }
+   return std::upper_bound(x.begin() + lo + 1, x.begin() + hi, xx)
+      - x.begin() - 1;
+}
+
+} // namespace st_facilities
@@ -0,0 +1,149 @@
+/**
+ * @file LruCache.h
+ * @brief Thread-safe map that discards its least recently used entries
+ * beyond a given total cost.  This header is private to the
+ * st_facilities library.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_LruCache_h
+#define st_facilities_LruCache_h
+
+#include <cstddef>
+
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace st_facilities {
+
+/**
+ * @class LruCache
+ *
+ * @brief Values of type Value, keyed by Key.  Each entry also holds a
+ * Stamp identifying the version of the source of its value, e.g., a
+ * FileStamp, and a cost, e.g., its size in bytes; entries are
+ * discarded, least recently used first, while the total cost exceeds
+ * the capacity.  Caches that need no stamps use the default one.
+ */
+
+template<typename Key, typename Value, typename Stamp=int>
+class LruCache {
+
+public:
+
+   explicit LruCache(size_t capacity) : m_capacity(capacity), m_cost(0) {}
+
+   /// @return true, setting value, if key is cached with the given
+   ///         stamp.  An entry with another stamp is dropped.
+   bool find(const Key & key, const Stamp & stamp, Value & value) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      typename Entries::iterator it(m_entries.find(key));
+      if (it == m_entries.end()) {
+         return false;
+      }
+      if (!(it->second.stamp == stamp)) {
+         erase(it);
+         return false;
+      }
+      m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+      value = it->second.value;
+      return true;
+   }
+
+   bool find(const Key & key, Value & value) {
+      return find(key, Stamp(), value);
+   }
+
+   /// @brief Cache value for key, replacing any entry with another
+   ///        stamp.  Values costing more than the capacity are not
+   ///        cached.
+   /// @return The cached value, which differs from value if another
+   ///         thread has inserted one for key and stamp meanwhile.
+   Value insert(const Key & key, const Stamp & stamp, const Value & value,
+                size_t cost=1) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      typename Entries::iterator it(m_entries.find(key));
+      if (it != m_entries.end()) {
+         if (it->second.stamp == stamp) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            return it->second.value;
+         }
+         erase(it);
+      }
+      if (cost > m_capacity) {
+         return value;
+      }
+      m_lru.push_front(key);
+      Entry & entry(m_entries[key]);
+      entry.value = value;
+      entry.stamp = stamp;
+      entry.cost = cost;
+      entry.lru = m_lru.begin();
+      m_cost += cost;
+      evict();
+      return value;
+   }
+
+   Value insert(const Key & key, const Value & value, size_t cost=1) {
+      return insert(key, Stamp(), value, cost);
+   }
+
+   void setCapacity(size_t capacity) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_capacity = capacity;
+      evict();
+   }
+
+   size_t capacity() const {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_capacity;
+   }
+
+   void clear() {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_entries.clear();
+      m_lru.clear();
+      m_cost = 0;
+   }
+
+private:
+
+   struct Entry {
+      Value value;
+      Stamp stamp;
+      size_t cost;
+      typename std::list<Key>::iterator lru;
+   };
+
+   typedef std::map<Key, Entry> Entries;
+
+   mutable std::mutex m_mutex;
+
+   Entries m_entries;
+
+   /// Keys in order of use, most recent first.
+   std::list<Key> m_lru;
+
+   size_t m_capacity;
+
+   size_t m_cost;
+
+   void erase(typename Entries::iterator it) {
+      m_cost -= it->second.cost;
+      m_lru.erase(it->second.lru);
+      m_entries.erase(it);
+   }
+
+   void evict() {
+      while (m_cost > m_capacity && !m_lru.empty()) {
+         erase(m_entries.find(m_lru.back()));
+      }
+   }
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_LruCache_h
@@ -0,0 +1,199 @@
+/**
+ * @file MultiFileTable.cxx
+ * @brief Implementation for MultiFileTable.
+ *
+ * $Header$
+ */
+
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+#include "st_facilities/FitsUtil.h"
+#include "st_facilities/MultiFileTable.h"
+
+namespace {
+   /// Position in the sorted rows of one table during a k-way merge.
+   struct Cursor {
+      Cursor(double value, size_t table, size_t pos) 
+         : value(value), table(table), pos(pos) {}
+      double value;
+      size_t table;
+      size_t pos;
+   };
+
+   /// Orders cursors so that a priority_queue yields the smallest
+   /// value first, and, for equal values, the earliest table.
+   class Later {
+   public:
+      bool operator()(const Cursor & a, const Cursor & b) const {
+         return a.value > b.value || (a.value == b.value && a.table > b.table);
+      }
+   };
+
+   class LessByValue {
+   public:
+      LessByValue(const std::vector<double> & values) : m_values(values) {}
+      bool operator()(size_t i, size_t j) const {
+         return m_values[i] < m_values[j];
+      }
+   private:
+      const std::vector<double> & m_values;
+   };
+}
+
+namespace st_facilities {
+
+MultiFileTable::MultiFileTable(const std::vector<std::string> & files,
+                               const std::string & extName,
+                               const std::vector<std::string> & columnNames,
+                               size_t nthreads)
+   : m_files(files), m_extName(extName), m_columnNames(columnNames),
+     m_nthreads(nthreads), m_next(0), m_current(0) {
+   startPrefetch();
+}
+
+MultiFileTable::~MultiFileTable() {
+   if (m_prefetch.valid()) {
+      m_prefetch.wait();
+   }
+}
+
+void MultiFileTable::startPrefetch() {
+   if (m_next >= m_files.size()) {
+      return;
+   }
+   std::string file(m_files[m_next]);
+   m_prefetch = std::async(std::launch::async, [this, file]() {
+      Table table;
+      FitsUtil::getTableColumns(file, m_extName, m_columnNames,
+                                table.columns, table.repeats, m_nthreads);
+      return table;
+   });
+   m_next++;
+}
+
+bool MultiFileTable::nextTable(Table & table) {
+   if (!m_prefetch.valid()) {
+      return false;
+   }
+   m_current = m_next - 1;
+   try {
+      table = m_prefetch.get();
+   } catch (...) {
+// Keep reading the following files, so that the caller may skip
+// this one.
+      startPrefetch();
+      throw;
+   }
+   startPrefetch();
+   return true;
+}
+
+bool MultiFileTable::next(Columns & columns) {
+   Table table;
+   if (!nextTable(table)) {
+      return false;
+   }
+   columns.swap(table.columns);
+   return true;
+}
+
+void MultiFileTable::readAll(Columns & columns) {
+   Columns all(m_columnNames.size());
+   Columns table;
+   while (next(table)) {
+      for (size_t k(0); k < all.size(); k++) {
+         all[k].insert(all[k].end(), table[k].begin(), table[k].end());
+      }
+   }
+   columns.swap(all);
+}
+
+void MultiFileTable::readMerged(const std::string & sortColumn,
+                                Columns & columns) {
+   size_t key(std::find(m_columnNames.begin(), m_columnNames.end(),
+                        sortColumn) - m_columnNames.begin());
+   if (key == m_columnNames.size()) {
+      throw std::invalid_argument("MultiFileTable::readMerged: "
+                                  + sortColumn + " is not being read");
+   }
+// Each column must have the same number of elements per row in every
+// file.
+   std::vector<Table> tables;
+   Table table;
+   while (nextTable(table)) {
+      if (table.repeats[key] != 1) {
+         throw std::invalid_argument("MultiFileTable::readMerged: "
+                                     + sortColumn + " in " 
+                                     + m_files[m_current]
+                                     + " is not a scalar column");
+      }
+      for (size_t k(0); !tables.empty() && k < table.repeats.size(); k++) {
+         if (table.repeats[k] != tables.front().repeats[k]) {
+            throw std::invalid_argument("MultiFileTable::readMerged: "
+                                        + m_columnNames[k] + " in "
+                                        + m_files[m_current]
+                                        + " has a different number of "
+                                        "elements per row than in the "
+                                        "preceding files");
+         }
+      }
+      tables.push_back(Table());
+      tables.back().columns.swap(table.columns);
+      tables.back().repeats.swap(table.repeats);
+   }
+   std::vector<size_t> repeat(m_columnNames.size(), 0);
+   if (!tables.empty()) {
+      repeat = tables.front().repeats;
+   }
+
+// The row order of each table, which is left empty if the table is
+// already sorted.
+   std::vector< std::vector<size_t> > order(tables.size());
+   size_t nrows(0);
+   for (size_t i(0); i < tables.size(); i++) {
+      const std::vector<double> & values(tables[i].columns[key]);
+      nrows += values.size();
+      if (!std::is_sorted(values.begin(), values.end())) {
+         order[i].resize(values.size());
+         for (size_t j(0); j < values.size(); j++) {
+            order[i][j] = j;
+         }
+         std::stable_sort(order[i].begin(), order[i].end(),
+                          LessByValue(values));
+      }
+   }
+
+   Columns merged(m_columnNames.size());
+   for (size_t k(0); k < merged.size(); k++) {
+      merged[k].reserve(nrows*repeat[k]);
+   }
+   std::priority_queue<Cursor, std::vector<Cursor>, Later> cursors;
+   for (size_t i(0); i < tables.size(); i++) {
+      const std::vector<double> & values(tables[i].columns[key]);
+      if (!values.empty()) {
+         size_t row(order[i].empty() ? 0 : order[i][0]);
+         cursors.push(Cursor(values[row], i, 0));
+      }
+   }
+   while (!cursors.empty()) {
+      Cursor cursor(cursors.top());
+      cursors.pop();
+      const Columns & source(tables[cursor.table].columns);
+      const std::vector<size_t> & rows(order[cursor.table]);
+      size_t row(rows.empty() ? cursor.pos : rows[cursor.pos]);
+      for (size_t k(0); k < merged.size(); k++) {
+         std::vector<double>::const_iterator first(source[k].begin() 
+                                                   + row*repeat[k]);
+         merged[k].insert(merged[k].end(), first, first + repeat[k]);
+      }
+      if (++cursor.pos < source[key].size()) {
+         row = rows.empty() ? cursor.pos : rows[cursor.pos];
+         cursors.push(Cursor(source[key][row], cursor.table, cursor.pos));
+      }
+   }
+   columns.swap(merged);
+}
+
+} // namespace st_facilities
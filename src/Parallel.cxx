@@ -0,0 +1,90 @@
+/**
+ * @file Parallel.cxx
+ * @brief Implementation of the fork-join helper.
+ *
+ * $Header$
+ */
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Parallel.h"
+
+namespace {
+/// Joins the threads started so far when it goes out of scope, so
+/// that none is left running (which would call std::terminate) if
+/// starting a later thread throws.
+   class Joiner {
+   public:
+      Joiner(std::vector<std::thread> & threads) : m_threads(threads) {}
+      ~Joiner() {
+         join();
+      }
+      void join() {
+         for (size_t k(0); k < m_threads.size(); k++) {
+            if (m_threads[k].joinable()) {
+               m_threads[k].join();
+            }
+         }
+      }
+   private:
+      std::vector<std::thread> & m_threads;
+   };
+}
+
+namespace st_facilities {
+
+namespace Parallel {
+
+size_t defaultThreads() {
+   size_t nthreads(std::thread::hardware_concurrency());
+   return nthreads > 0 ? nthreads : 1;
+}
+
+void forChunks(size_t n, size_t nthreads, size_t minChunk,
+               const std::function<void(size_t, size_t)> & body) {
+   if (n == 0) {
+      return;
+   }
+   if (nthreads == 0) {
+      nthreads = defaultThreads();
+   }
+   size_t nchunks(std::min(nthreads, n/std::max(minChunk, size_t(1))));
+   if (nchunks <= 1) {
+      body(0, n);
+      return;
+   }
+
+   std::exception_ptr error;
+   std::mutex error_mutex;
+   std::function<void(size_t, size_t)> guarded = 
+      [&](size_t begin, size_t end) {
+      try {
+         body(begin, end);
+      } catch (...) {
+         std::lock_guard<std::mutex> lock(error_mutex);
+         if (!error) {
+            error = std::current_exception();
+         }
+      }
+   };
+
+   std::vector<std::thread> threads;
+   Joiner joiner(threads);
+   threads.reserve(nchunks - 1);
+   for (size_t k(1); k < nchunks; k++) {
+      threads.push_back(std::thread(guarded, k*n/nchunks, (k + 1)*n/nchunks));
+   }
+   guarded(0, n/nchunks);
+   joiner.join();
+   if (error) {
+      std::rethrow_exception(error);
+   }
+}
+
+} // namespace Parallel
+
+} // namespace st_facilities
@@ -0,0 +1,37 @@
+/**
+ * @file Parallel.h
+ * @brief Fork-join helper for splitting loops across threads.  This
+ * header is private to the st_facilities library.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_Parallel_h
+#define st_facilities_Parallel_h
+
+#include <cstddef>
+#include <functional>
+
+namespace st_facilities {
+
+namespace Parallel {
+
+/// @return The number of threads to use when nthreads is zero, i.e.,
+///         the number of hardware threads, or 1 if that is unknown.
+size_t defaultThreads();
+
+/// @brief Split [0, n) into at most nthreads contiguous chunks of at
+///        least minChunk items and call body(begin, end) for each
+///        chunk, concurrently.  The calling thread processes the first
+///        chunk.  If any call throws, the first exception is rethrown
+///        after all threads have finished.
+/// @param nthreads Maximum number of threads; zero selects
+///        defaultThreads().
+void forChunks(size_t n, size_t nthreads, size_t minChunk,
+               const std::function<void(size_t, size_t)> & body);
+
+} // namespace Parallel
+
+} // namespace st_facilities
+
+#endif // st_facilities_Parallel_h
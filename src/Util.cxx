@@ -7,6 +7,7 @@
  */
 
 #include <cassert>
+#include <cstring>
 
 #include <algorithm>
 #include <fstream>
@@ -24,9 +25,18 @@
 #include "astro/SkyDir.h"
 #include "astro/SkyProj.h"
 
+#include "st_facilities/Interpolator1D.h"
+#include "st_facilities/MatrixView.h"
 #include "st_facilities/Util.h"
 
+#include "FileStamp.h"
+#include "LruCache.h"
+#include "Parallel.h"
+
 namespace {
+/// Smallest number of points worth handing to a separate thread.
+   const size_t s_minChunk(1024);
+
    bool reverse_cmp(double x, double y) {
       return x > y;
    }
@@ -55,6 +65,69 @@ namespace {
          }
       }
    }
+   std::vector<double>::const_iterator
+   cellIndex(const std::vector<double> & xx, double x) {
+      if (x < xx.front()) {
+         return xx.begin() + 1;
+      } else if (x >= xx.back()) {
+         return xx.end() - 1;
+      }
+      return std::upper_bound(xx.begin(), xx.end(), x);
+   }
+
+/// Results of Util::isFitsFile for regular files, keyed by canonical
+/// path, with the least recently used entries discarded beyond a fixed
+/// number.
+   st_facilities::LruCache<std::string, bool, st_facilities::FileStamp> &
+   fitsProbeCache() {
+      static st_facilities::LruCache<std::string, bool,
+                                     st_facilities::FileStamp> cache(4096);
+      return cache;
+   }
+
+   bool openWithCfitsio(const std::string & infile) {
+      fitsfile * fp(0);
+      int status(0);
+      fits_open_file(&fp, const_cast<char *>(infile.c_str()), 
+                     READONLY, &status);
+      if (0 != status) {
+         return false;
+      }
+      fits_close_file(fp, &status);
+      if (status != 0) {
+         throw std::runtime_error("Util::isFitsFile: Error closing file "
+                                  + infile);
+      }
+      return true;
+   }
+
+/// Test the first header block of a plain file: a FITS file starts
+/// with SIMPLE = T.  Files with gzip, compress, pkzip or bzip2
+/// signatures, which cfitsio reads transparently, are opened with
+/// cfitsio.
+   bool probeFitsFile(const std::string & infile) {
+      std::ifstream file(infile.c_str(), std::ios::binary);
+      char block[2880];
+      file.read(block, sizeof(block));
+      size_t nread(file.gcount());
+      const unsigned char * bytes(reinterpret_cast<unsigned char *>(block));
+      if ((nread >= 2 && bytes[0] == 0x1f 
+           && (bytes[1] == 0x8b || bytes[1] == 0x9d))
+          || (nread >= 4 && std::memcmp(block, "PK\3\4", 4) == 0)
+          || (nread >= 3 && std::memcmp(block, "BZh", 3) == 0)) {
+         return openWithCfitsio(infile);
+      }
+      if (nread < sizeof(block) || std::memcmp(block, "SIMPLE  =", 9) != 0) {
+         return false;
+      }
+      for (size_t i(9); i < 80; i++) {
+         if (block[i] != ' ') {
+            return block[i] == 'T';
+         }
+      }
+      return false;
+   }
+
    void strip_at_sign(std::string & input) {
       if (input.find_first_of("@") == 0) {
          std::string output = "";
@@ -115,19 +188,22 @@ namespace st_facilities {
    }
 
    bool Util::isFitsFile(const std::string & infile) {
-      fitsfile * fp(0);
-      int status(0);
-      fits_open_file(&fp, const_cast<char *>(infile.c_str()), 
-                     READONLY, &status);
-      if (0 != status) {
-         return false;
+      std::string path;
+      FileStamp stamp;
+      if (!getFileStamp(infile, path, stamp, true)) {
+         return openWithCfitsio(infile);
       }
-      fits_close_file(fp, &status);
-      if (status != 0) {
-         throw std::runtime_error("Util::isFitsFile: Error closing file "
-                                  + infile);
+      bool isFits;
+      if (fitsProbeCache().find(path, stamp, isFits)) {
+         return isFits;
       }
-      return true;
+      isFits = probeFitsFile(infile);
+      fitsProbeCache().insert(path, stamp, isFits);
+      return isFits;
+   }
+
+   void Util::clearFitsFileCache() {
+      fitsProbeCache().clear();
    }
 
    void Util::resolve_fits_files(std::string filename, 
@@ -173,13 +249,32 @@ namespace st_facilities {
       std::vector<double>::const_iterator it 
          = std::upper_bound(x.begin(), x.end(), xx) - 1;
       unsigned int indx = it - x.begin();
-      double yy;
-      if (*(it+1) != *it) {
-         yy = (xx - *it)/(*(it+1) - *it)*(y[indx+1] - y[indx]) + y[indx];
-      } else {
-         yy = (y[indx+1] + y[indx])/2.;
+      return Interpolator1D::interpolate(x, y, indx, xx);
+   }
+
+   void Util::interpolate(const std::vector<double> &x,
+                          const std::vector<double> &y,
+                          const std::vector<double> &xx,
+                          std::vector<double> &yy) {
+      yy.resize(xx.size());
+      size_t indx(0);
+      for (size_t k(0); k < xx.size(); k++) {
+         if (!(xx[k] >= x.front() && xx[k] <= x.back())) {
+            std::ostringstream message;
+            message << "Util::interpolate:\n"
+                    << "abscissa value out-of-range, "
+                    << xx[k] << " is not in (" 
+                    << x.front() << ", "
+                    << x.back() << ")";
+            throw std::range_error(message.str());
+         }
+         if (xx[k] == x.back()) {
+            yy[k] = y.back();
+            continue;
+         }
+         indx = Interpolator1D::hunt(x, xx[k], indx);
+         yy[k] = Interpolator1D::interpolate(x, y, indx, xx[k]);
       }
-      return yy;
    }
 
    double Util::bilinear(const std::vector<double> &xx, double x, 
@@ -229,24 +324,10 @@ namespace st_facilities {
                          const std::vector<double> &yy, double y, 
                          const std::vector< std::vector<double> > &z) {
 
-      std::vector<double>::const_iterator ix;
-      if (x < *(xx.begin())) {
-         ix = xx.begin() + 1;
-      } else if (x >= *(xx.end()-1)) {
-         ix = xx.end() - 1;
-      } else {
-         ix = std::upper_bound(xx.begin(), xx.end(), x);
-      }
+      std::vector<double>::const_iterator ix = ::cellIndex(xx, x);
       int i = ix - xx.begin();
       
-      std::vector<double>::const_iterator iy;
-      if (y < *(yy.begin())) {
-         iy = yy.begin() + 1;
-      } else if (y >= *(yy.end()-1)) {
-         iy = yy.end() - 1;
-      } else {
-         iy = std::upper_bound(yy.begin(), yy.end(), y);
-      }
+      std::vector<double>::const_iterator iy = ::cellIndex(yy, y);
       int j = iy - yy.begin();
       
       double tt = (x - *(ix-1))/(*(ix) - *(ix-1));
@@ -276,6 +357,35 @@ namespace st_facilities {
       return value;
    }
 
+   double Util::bilinear(const std::vector<double> &xx, double x, 
+                         const std::vector<double> &yy, double y, 
+                         const MatrixView &z) {
+      if (z.nrows() != xx.size() || z.ncols() != yy.size()) {
+         throw std::invalid_argument("Util::bilinear: table dimensions "
+                                     "do not match the abscissae");
+      }
+      std::vector<double>::const_iterator ix = ::cellIndex(xx, x);
+      int i = ix - xx.begin();
+      
+      std::vector<double>::const_iterator iy = ::cellIndex(yy, y);
+      int j = iy - yy.begin();
+      
+      double tt = (x - *(ix-1))/(*(ix) - *(ix-1));
+      double uu = (y - *(iy-1))/(*(iy) - *(iy-1));
+
+      const double * row0 = z.row(i-1);
+      const double * row1 = z.row(i);
+      
+      double y1 = row0[j-1];
+      double y2 = row1[j-1];
+      double y3 = row1[j];
+      double y4 = row0[j];
+
+      double value = (1. - tt)*(1. - uu)*y1 + tt*(1. - uu)*y2 
+         + tt*uu*y3 + (1. - tt)*uu*y4; 
+      return value;
+   }
+
    bool Util::expectedException(const std::exception & eObj, 
                                 const std::string & targetMessage) {
       std::string message(eObj.what());
@@ -317,30 +427,89 @@ namespace st_facilities {
    void Util::skyDir2pixel(const astro::ProjBase & proj,
                            const astro::SkyDir & dir,
                            double & i, double & j) {
-      std::pair<double, double> pixels;
+      double lon, lat;
       if (proj.isGalactic()) {
-         pixels = proj.sph2pix(dir.l(), dir.b());
+         lon = dir.l();
+         lat = dir.b();
       } else {
-         pixels = proj.sph2pix(dir.ra(), dir.dec());
+         lon = dir.ra();
+         lat = dir.dec();
       }
-      i = pixels.first;
-      j = pixels.second;
+      skyDir2pixel(proj, &lon, &lat, &i, &j, 1);
    }
 
    // EAC, switch to using ProjBase base class (instead of SkyProj)
    void Util::pixel2SkyDir(const astro::ProjBase & proj, double i, double j,
                            astro::SkyDir & dir) {
-      std::pair<double, double> coords;
-      coords = proj.pix2sph(i, j);
+      double lon, lat;
+      pixel2SkyDir(proj, &i, &j, &lon, &lat, 1);
       if (proj.isGalactic()) {
-         dir = astro::SkyDir(coords.first, coords.second,
-                             astro::SkyDir::GALACTIC);
+         dir = astro::SkyDir(lon, lat, astro::SkyDir::GALACTIC);
       } else {
-         dir = astro::SkyDir(coords.first, coords.second,
-                             astro::SkyDir::EQUATORIAL);
+         dir = astro::SkyDir(lon, lat, astro::SkyDir::EQUATORIAL);
       }         
    }
 
+   void Util::skyDir2pixel(const astro::ProjBase & proj,
+                           const double * lon, const double * lat,
+                           double * i, double * j, size_t n) {
+      for (size_t k(0); k < n; k++) {
+         std::pair<double, double> pixels(proj.sph2pix(lon[k], lat[k]));
+         i[k] = pixels.first;
+         j[k] = pixels.second;
+      }
+   }
+
+   void Util::skyDir2pixel(const std::vector<const astro::ProjBase *> & projs,
+                           const double * lon, const double * lat,
+                           double * i, double * j, size_t n) {
+      if (projs.empty()) {
+         throw std::invalid_argument("Util::skyDir2pixel: "
+                                     "no projections given");
+      }
+      size_t nchunks(std::min(projs.size(), 
+                              std::max(n/s_minChunk, size_t(1))));
+      Parallel::forChunks(nchunks, nchunks, 1,
+                          [&](size_t first, size_t last) {
+         for (size_t c(first); c < last; c++) {
+            size_t begin(c*n/nchunks);
+            size_t end((c + 1)*n/nchunks);
+            skyDir2pixel(*projs[c], lon + begin, lat + begin, 
+                         i + begin, j + begin, end - begin);
+         }
+      });
+   }
+
+   void Util::pixel2SkyDir(const astro::ProjBase & proj,
+                           const double * i, const double * j,
+                           double * lon, double * lat, size_t n) {
+      for (size_t k(0); k < n; k++) {
+         std::pair<double, double> coords(proj.pix2sph(i[k], j[k]));
+         lon[k] = coords.first;
+         lat[k] = coords.second;
+      }
+   }
+
+   void Util::pixel2SkyDir(const std::vector<const astro::ProjBase *> & projs,
+                           const double * i, const double * j,
+                           double * lon, double * lat, size_t n) {
+      if (projs.empty()) {
+         throw std::invalid_argument("Util::pixel2SkyDir: "
+                                     "no projections given");
+      }
+      size_t nchunks(std::min(projs.size(), 
+                              std::max(n/s_minChunk, size_t(1))));
+      Parallel::forChunks(nchunks, nchunks, 1,
+                          [&](size_t first, size_t last) {
+         for (size_t c(first); c < last; c++) {
+            size_t begin(c*n/nchunks);
+            size_t end((c + 1)*n/nchunks);
+            pixel2SkyDir(*projs[c], i + begin, j + begin, 
+                         lon + begin, lat + begin, end - begin);
+         }
+      });
+   }
+
    astro::JulianDate Util::currentTime() {
       std::time_t my_time = std::time(0);
       std::tm * now = std::gmtime(&my_time);
@@ -10,22 +10,52 @@
 #include <fenv.h>
 #endif
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include <cmath>
+
 #include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 
 #include <cppunit/ui/text/TextTestRunner.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include "st_facilities/Bilinear.h"
+#include "st_facilities/BinLocator.h"
+#include "st_facilities/CubicSpline.h"
 #include "st_facilities/dgaus8.h"
 #include "st_facilities/GaussianQuadrature.h"
 #include "st_facilities/RootFinder.h"
 #include "PowerLaw.h"
+#include "../BilinearSimd.h"
+
+#include "fitsio.h"
+
+#include "tip/IFileSvc.h"
+#include "tip/Table.h"
+
+#include "astro/SkyDir.h"
+#include "astro/SkyProj.h"
 
 #include "st_facilities/Env.h"
 #include "st_facilities/FileSys.h"
 #include "st_facilities/FitsImage.h"
+#include "st_facilities/FitsTable.h"
+#include "st_facilities/FitsUtil.h"
+#include "st_facilities/ImageView.h"
+#include "st_facilities/Interpolator1D.h"
+#include "st_facilities/MatrixView.h"
+#include "st_facilities/MultiFileTable.h"
+#include "st_facilities/MultiLinear.h"
 #include "st_facilities/Util.h"
 
 using namespace st_facilities;
@@ -37,10 +67,36 @@ class st_facilitiesTests : public CppUnit::TestFixture {
    CPPUNIT_TEST(test_dgaus8);
    CPPUNIT_TEST(test_GaussianQuadrature);
    CPPUNIT_TEST(test_RootFinder);
+   CPPUNIT_TEST(test_Bilinear);
+   CPPUNIT_TEST(test_BilinearSimd);
+   CPPUNIT_TEST(test_BinLocator);
+   CPPUNIT_TEST(test_MultiLinear);
+   CPPUNIT_TEST(test_Util_bilinear);
+   CPPUNIT_TEST(test_Interpolator1D);
+   CPPUNIT_TEST(test_CubicSpline);
+   CPPUNIT_TEST(test_ImageView);
    CPPUNIT_TEST_EXCEPTION(test_Util_file_ok, std::runtime_error);
    CPPUNIT_TEST(test_Util_readLines);
    CPPUNIT_TEST(test_Util_expectedException);
    CPPUNIT_TEST(test_Util_resolve_fits_files);
+   CPPUNIT_TEST(test_Util_isFitsFile);
+   CPPUNIT_TEST(test_Util_skyDir2pixel);
+   CPPUNIT_TEST(test_FitsTable_getVectorData);
+   CPPUNIT_TEST(test_FitsTable_setPar);
+   CPPUNIT_TEST(test_FitsTable_cache);
+   CPPUNIT_TEST(test_FitsUtil_getTableVector);
+   CPPUNIT_TEST(test_FitsUtil_getTableColumns);
+   CPPUNIT_TEST(test_FitsUtil_rowRanges);
+   CPPUNIT_TEST(test_FitsUtil_getRecordVectors);
+   CPPUNIT_TEST(test_FitsUtil_writeChecksums);
+   CPPUNIT_TEST(test_FitsUtil_updateChecksums);
+   CPPUNIT_TEST(test_FitsUtil_filterCopy);
+   CPPUNIT_TEST(test_MultiFileTable);
+   CPPUNIT_TEST(test_FitsImage_loadModes);
+   CPPUNIT_TEST(test_FitsImage_plane);
+   CPPUNIT_TEST(test_FitsImage_projection);
+   CPPUNIT_TEST(test_FitsImage_getSolidAngles);
+   CPPUNIT_TEST(test_FitsImage_getRowSolidAngles);
    CPPUNIT_TEST(test_Env_appendNames);
 //   CPPUNIT_TEST(test_Env_expandEnvVar);
 //    CPPUNIT_TEST(test_Env_getDataDir);
@@ -56,10 +112,36 @@ public:
    void test_dgaus8();
    void test_GaussianQuadrature();
    void test_RootFinder();
+   void test_Bilinear();
+   void test_BilinearSimd();
+   void test_BinLocator();
+   void test_MultiLinear();
+   void test_Util_bilinear();
+   void test_Interpolator1D();
+   void test_CubicSpline();
+   void test_ImageView();
    void test_Util_file_ok();
    void test_Util_readLines();
    void test_Util_expectedException();
    void test_Util_resolve_fits_files();
+   void test_Util_isFitsFile();
+   void test_Util_skyDir2pixel();
+   void test_FitsTable_getVectorData();
+   void test_FitsTable_setPar();
+   void test_FitsTable_cache();
+   void test_FitsUtil_getTableVector();
+   void test_FitsUtil_getTableColumns();
+   void test_FitsUtil_rowRanges();
+   void test_FitsUtil_getRecordVectors();
+   void test_FitsUtil_writeChecksums();
+   void test_FitsUtil_updateChecksums();
+   void test_FitsUtil_filterCopy();
+   void test_MultiFileTable();
+   void test_FitsImage_loadModes();
+   void test_FitsImage_plane();
+   void test_FitsImage_projection();
+   void test_FitsImage_getSolidAngles();
+   void test_FitsImage_getRowSolidAngles();
    void test_Env_appendNames();
    void test_Env_expandEnvVar();
    void test_Env_getDataDir();
@@ -230,6 +312,429 @@ void st_facilitiesTests::test_RootFinder() {
 #endif // ScienceTools
 }
 
+void st_facilitiesTests::test_Bilinear() {
+   std::vector<double> xx;
+   std::vector<double> yy;
+   for (size_t i(0); i < 10; i++) {
+      xx.push_back(0.5 + 0.25*i);
+   }
+   for (size_t j(0); j < 8; j++) {
+      yy.push_back(-0.9 + 0.2*j);
+   }
+   std::vector<double> zz;
+   for (size_t j(0); j < yy.size(); j++) {
+      for (size_t i(0); i < xx.size(); i++) {
+         zz.push_back(2.*xx[i] - 3.*yy[j] + xx[i]*yy[j]);
+      }
+   }
+   Bilinear bilinear(xx, yy, zz, 0, 10, -1, 1);
+
+// Interpolation of a bilinear function is exact inside the grid.
+   double x(1.3), y(0.15);
+   double tol(1e-12);
+   CPPUNIT_ASSERT(std::fabs(bilinear(x, y) - (2.*x - 3.*y + x*y)) < tol);
+
+   std::vector<double> xvals;
+   std::vector<double> yvals;
+   for (size_t k(0); k < 101; k++) {
+      xvals.push_back(0.1*k);
+      yvals.push_back(-1. + 0.02*k);
+   }
+   std::vector<double> values(xvals.size());
+   bilinear.evaluate(&xvals[0], &yvals[0], &values[0], xvals.size());
+   for (size_t k(0); k < xvals.size(); k++) {
+      CPPUNIT_ASSERT(values[k] == bilinear(xvals[k], yvals[k]));
+   }
+
+   x = 10.5;
+   try {
+      bilinear.evaluate(&x, &y, &values[0], 1);
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+}
+
+void st_facilitiesTests::test_BilinearSimd() {
+// Run each vector kernel the host supports directly on the padded
+// grid that Bilinear builds, and compare with the scalar code.
+   std::vector<double> xx;
+   std::vector<double> yy;
+   for (size_t i(0); i < 10; i++) {
+      xx.push_back(0.5 + 0.25*i);
+   }
+   for (size_t j(0); j < 8; j++) {
+      yy.push_back(-0.9 + 0.2*j);
+   }
+   std::vector<double> zz;
+   for (size_t j(0); j < yy.size(); j++) {
+      for (size_t i(0); i < xx.size(); i++) {
+         zz.push_back(std::sin(3.*xx[i])*std::cos(2.*yy[j]));
+      }
+   }
+   Bilinear bilinear(xx, yy, zz, 0, 10, -1, 1);
+
+   std::vector<double> px(1, 0.);
+   px.insert(px.end(), xx.begin(), xx.end());
+   px.push_back(10.);
+   std::vector<double> py(1, -1.);
+   py.insert(py.end(), yy.begin(), yy.end());
+   py.push_back(1.);
+   std::vector<double> pz;
+   for (size_t jp(0); jp < py.size(); jp++) {
+      size_t j(std::min(std::max(jp, size_t(1)) - 1, yy.size() - 1));
+      for (size_t ip(0); ip < px.size(); ip++) {
+         size_t i(std::min(std::max(ip, size_t(1)) - 1, xx.size() - 1));
+         pz.push_back(zz[j*xx.size() + i]);
+      }
+   }
+   BinLocator xlocator(px);
+   BinLocator ylocator(py);
+
+   std::vector<double> xvals;
+   std::vector<double> yvals;
+   for (size_t k(0); k < 101; k++) {
+      xvals.push_back(0.1*k);
+      yvals.push_back(-1. + 0.02*k);
+   }
+   size_t npts(xvals.size());
+   std::vector<double> values(npts);
+
+   std::vector<BilinearSimd::Kernel> kernels(BilinearSimd::kernels());
+   for (size_t m(0); m < kernels.size(); m++) {
+// Exercise both the arithmetic and the binary-search bracketing.
+      for (int uniform(0); uniform < 2; uniform++) {
+         BilinearSimd::Grid grid;
+         grid.x.grid = &px[0];
+         grid.x.n = px.size();
+         grid.x.uniform = uniform && xlocator.isUniform() &&
+            !xlocator.isLogUniform();
+         xlocator.getSpacing(grid.x.first, grid.x.nsteps,
+                             grid.x.origin, grid.x.invStep);
+         grid.y.grid = &py[0];
+         grid.y.n = py.size();
+         grid.y.uniform = uniform && ylocator.isUniform() &&
+            !ylocator.isLogUniform();
+         ylocator.getSpacing(grid.y.first, grid.y.nsteps,
+                             grid.y.origin, grid.y.invStep);
+         grid.z = &pz[0];
+
+         std::fill(values.begin(), values.end(), 0);
+         size_t ndone(kernels[m](grid, &xvals[0], &yvals[0], &values[0],
+                                 npts));
+// All points are in range, so only a partial block is left over.
+         CPPUNIT_ASSERT(ndone <= npts && npts - ndone < 8);
+         for (size_t k(0); k < ndone; k++) {
+            CPPUNIT_ASSERT(values[k] == bilinear(xvals[k], yvals[k]));
+         }
+
+// A block with an out-of-range point is left to the scalar code.
+         std::vector<double> xbad(xvals);
+         xbad[0] = 10.5;
+         CPPUNIT_ASSERT(kernels[m](grid, &xbad[0], &yvals[0], &values[0],
+                                   npts) == 0);
+      }
+   }
+}
+
+void st_facilitiesTests::test_BinLocator() {
+   std::vector<double> linear;
+   std::vector<double> logarithmic;
+   std::vector<double> padded;
+   std::vector<double> irregular;
+   padded.push_back(-1.);
+   for (size_t i(0); i < 20; i++) {
+      linear.push_back(0.75 + 0.25*i);
+      logarithmic.push_back(30.*std::pow(10., 0.1*i));
+      padded.push_back(-0.975 + 0.05*i);
+      irregular.push_back(i*i);
+   }
+   padded.push_back(1.);
+
+   std::vector< std::vector<double> > grids;
+   grids.push_back(linear);
+   grids.push_back(logarithmic);
+   grids.push_back(padded);
+   grids.push_back(irregular);
+
+   CPPUNIT_ASSERT(BinLocator(linear).isUniform());
+   CPPUNIT_ASSERT(BinLocator(logarithmic).isLogUniform());
+   CPPUNIT_ASSERT(BinLocator(padded).isUniform());
+   CPPUNIT_ASSERT(!BinLocator(irregular).isUniform());
+
+   for (size_t k(0); k < grids.size(); k++) {
+      const std::vector<double> & grid(grids[k]);
+      BinLocator locator(grid);
+      std::vector<double> xvals(grid);
+      double dx((grid.back() - grid.front())/1000.);
+      for (size_t i(0); i < 1100; i++) {
+         xvals.push_back(grid.front() + (i - 50.)*dx);
+      }
+      for (size_t i(0); i < xvals.size(); i++) {
+         size_t expected(std::upper_bound(grid.begin(), grid.end(), xvals[i])
+                         - grid.begin());
+         CPPUNIT_ASSERT(locator.upperBound(xvals[i]) == expected);
+      }
+   }
+}
+
+namespace {
+   double trilinear(double x, double y, double z) {
+      return 1. + 2.*x - y + 0.5*z + x*y - 3.*y*z + x*y*z;
+   }
+}
+
+void st_facilitiesTests::test_MultiLinear() {
+   std::vector< std::vector<double> > axes(3);
+   for (size_t i(0); i < 12; i++) {
+      axes[0].push_back(1. + 0.25*i);
+   }
+   for (size_t j(0); j < 7; j++) {
+      axes[1].push_back(-1. + j*j/18.);
+   }
+   for (size_t k(0); k < 5; k++) {
+      axes[2].push_back(std::pow(10., 0.5*k));
+   }
+   std::vector<double> values;
+   for (size_t k(0); k < axes[2].size(); k++) {
+      for (size_t j(0); j < axes[1].size(); j++) {
+         for (size_t i(0); i < axes[0].size(); i++) {
+            values.push_back(trilinear(axes[0][i], axes[1][j], axes[2][k]));
+         }
+      }
+   }
+   MultiLinear<3> interpolator(axes, values);
+
+// Trilinear functions are reproduced exactly, including linear
+// extrapolation beyond the grid.
+   std::vector<double> points;
+   for (size_t n(0); n < 200; n++) {
+      points.push_back(0.9 + 0.02*n);
+      points.push_back(-1.05 + 0.01*n);
+      points.push_back(0.5 + 0.5*n);
+   }
+   size_t npts(points.size()/3);
+   std::vector<double> results(npts);
+   interpolator.evaluate(&points[0], &results[0], npts);
+   double tol(1e-10);
+   for (size_t n(0); n < npts; n++) {
+      const double * point(&points[3*n]);
+      double expected(trilinear(point[0], point[1], point[2]));
+      CPPUNIT_ASSERT(std::fabs(results[n] - expected) 
+                     < tol*std::max(1., std::fabs(expected)));
+      CPPUNIT_ASSERT(interpolator(point) == results[n]);
+   }
+
+   values.pop_back();
+   try {
+      MultiLinear<3> foo(axes, values);
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+}
+
+void st_facilitiesTests::test_Util_bilinear() {
+   std::vector<double> xx, yy;
+   for (size_t i(0); i < 9; i++) {
+      xx.push_back(std::log(1. + i));
+   }
+   for (size_t j(0); j < 6; j++) {
+      yy.push_back(-2. + 0.7*j);
+   }
+   std::vector< std::vector<double> > zz(xx.size());
+   for (size_t i(0); i < xx.size(); i++) {
+      for (size_t j(0); j < yy.size(); j++) {
+         zz[i].push_back(std::sin(xx[i])*std::cos(yy[j]) + xx[i]*yy[j]);
+      }
+   }
+   std::vector<double> data;
+   MatrixView view(MatrixView::flatten(zz, data));
+   CPPUNIT_ASSERT(view.nrows() == xx.size() && view.ncols() == yy.size());
+
+// The contiguous version must agree exactly with the vector of
+// vectors version, both inside and outside the grid.
+   for (double x(-0.2); x < 2.5; x += 0.037) {
+      for (double y(-2.5); y < 2.; y += 0.053) {
+         CPPUNIT_ASSERT(Util::bilinear(xx, x, yy, y, view)
+                        == Util::bilinear(xx, x, yy, y, zz));
+      }
+   }
+
+   try {
+      Util::bilinear(xx, 1., yy, 0., MatrixView(data, yy.size(), xx.size()));
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+}
+
+void st_facilitiesTests::test_Interpolator1D() {
+   std::vector<double> x, y;
+   for (size_t i(0); i < 50; i++) {
+      x.push_back(std::pow(double(i), 1.5));
+      y.push_back(std::sin(0.1*i));
+   }
+// Repeated abscissa values are averaged, as in Util::interpolate.
+   x[20] = x[21];
+   Interpolator1D interpolator(x, y);
+
+// Ascending, descending and scattered sequences give the same
+// results as Util::interpolate.
+   std::vector<double> xx;
+   for (double value(0); value <= x.back(); value += 0.37) {
+      xx.push_back(value);
+   }
+   xx.push_back(x.back());
+   xx.push_back(x[21]);
+   std::vector<double> sequence(xx);
+   for (size_t k(xx.size()); k > 0; k--) {
+      sequence.push_back(xx[k-1]);
+   }
+   for (size_t k(0); k < xx.size(); k++) {
+      sequence.push_back(xx[(k*7919) % xx.size()]);
+   }
+   for (size_t k(0); k < sequence.size(); k++) {
+      CPPUNIT_ASSERT(interpolator(sequence[k]) 
+                     == Util::interpolate(x, y, sequence[k]));
+   }
+
+   std::vector<double> yy;
+   Util::interpolate(x, y, sequence, yy);
+   CPPUNIT_ASSERT(yy.size() == sequence.size());
+   for (size_t k(0); k < sequence.size(); k++) {
+      CPPUNIT_ASSERT(yy[k] == Util::interpolate(x, y, sequence[k]));
+   }
+
+   try {
+      interpolator(x.back() + 1.);
+      CPPUNIT_ASSERT(false);
+   } catch (std::range_error &) {
+   }
+   sequence.push_back(-1.);
+   try {
+      Util::interpolate(x, y, sequence, yy);
+      CPPUNIT_ASSERT(false);
+   } catch (std::range_error &) {
+   }
+}
+
+void st_facilitiesTests::test_CubicSpline() {
+   std::vector<double> x, y, line;
+   for (size_t i(0); i < 12; i++) {
+      x.push_back(0.3*i + 0.01*i*i);
+      y.push_back(std::sin(x.back()));
+      line.push_back(2.*x.back() - 1.);
+   }
+   CubicSpline spline(x, y);
+   CubicSpline monotone(x, y, CubicSpline::MONOTONE);
+   CubicSpline straight(x, line);
+   CubicSpline straight_monotone(x, line, CubicSpline::MONOTONE);
+
+// Both methods pass through the nodes and reproduce linear functions.
+   double tol(1e-12);
+   for (size_t i(0); i < x.size(); i++) {
+      CPPUNIT_ASSERT(std::fabs(spline(x[i]) - y[i]) < tol);
+      CPPUNIT_ASSERT(std::fabs(monotone(x[i]) - y[i]) < tol);
+   }
+   std::vector<double> xx;
+   for (double value(0); value < x.back(); value += 0.013) {
+      xx.push_back(value);
+   }
+   for (size_t k(0); k < xx.size(); k++) {
+      CPPUNIT_ASSERT(std::fabs(straight(xx[k]) - (2.*xx[k] - 1.)) < tol);
+      CPPUNIT_ASSERT(std::fabs(straight_monotone(xx[k]) - (2.*xx[k] - 1.))
+                     < tol);
+   }
+
+// On this coarse grid the spline is far more accurate than linear
+// interpolation away from the ends, where the natural boundary
+// condition does not hold for sin(x).
+   double spline_error(0), linear_error(0);
+   for (size_t k(0); k < xx.size(); k++) {
+      if (xx[k] < x[2] || xx[k] > x[x.size() - 3]) {
+         continue;
+      }
+      spline_error = std::max(spline_error, 
+                              std::fabs(spline(xx[k]) - std::sin(xx[k])));
+      linear_error = std::max(linear_error,
+                              std::fabs(Util::interpolate(x, y, xx[k])
+                                        - std::sin(xx[k])));
+   }
+   CPPUNIT_ASSERT(spline_error < 0.1*linear_error);
+
+// Batch evaluation matches single calls.
+   std::vector<double> yy;
+   spline.evaluate(xx, yy);
+   CPPUNIT_ASSERT(yy.size() == xx.size());
+   for (size_t k(0); k < xx.size(); k++) {
+      CPPUNIT_ASSERT(yy[k] == spline(xx[k]));
+   }
+
+// The monotone interpolant of a step neither overshoots nor
+// oscillates; the spline does both.
+   std::vector<double> step;
+   for (size_t i(0); i < x.size(); i++) {
+      step.push_back(i < x.size()/2 ? 0. : 1.);
+   }
+   CubicSpline step_monotone(x, step, CubicSpline::MONOTONE);
+   CubicSpline step_spline(x, step);
+   step_monotone.evaluate(xx, yy);
+   bool overshoot(false);
+   for (size_t k(0); k < xx.size(); k++) {
+      CPPUNIT_ASSERT(yy[k] >= 0 && yy[k] <= 1);
+      CPPUNIT_ASSERT(k == 0 || yy[k] >= yy[k-1]);
+      double value(step_spline(xx[k]));
+      if (value < 0 || value > 1) {
+         overshoot = true;
+      }
+   }
+   CPPUNIT_ASSERT(overshoot);
+
+   try {
+      spline(x.back() + 0.1);
+      CPPUNIT_ASSERT(false);
+   } catch (std::range_error &) {
+   }
+   std::swap(x[3], x[4]);
+   try {
+      CubicSpline foo(x, y);
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+}
+
+void st_facilitiesTests::test_ImageView() {
+   size_t nx(7), ny(5), nz(3);
+   std::vector<float> image;
+   for (size_t k(0); k < nx*ny*nz; k++) {
+      image.push_back(0.5*k - 10.);
+   }
+   ImageView view(&image[0], image.size());
+   CPPUNIT_ASSERT(view.size() == image.size());
+   CPPUNIT_ASSERT(!view.isMapped());
+
+   std::vector<double> values;
+   view.get(values);
+   for (size_t k(0); k < image.size(); k++) {
+      CPPUNIT_ASSERT(values[k] == image[k]);
+   }
+
+// Column 3 of plane 1
+   ImageView plane(view.subView(nx*ny, nx*ny));
+   ImageView column(plane.subView(3, ny, nx));
+   CPPUNIT_ASSERT(column.size() == ny);
+   for (size_t j(0); j < ny; j++) {
+      CPPUNIT_ASSERT(column[j] == image[nx*ny + 3 + j*nx]);
+   }
+   double pixels[2];
+   column.get(3, 2, pixels);
+   CPPUNIT_ASSERT(pixels[0] == column[3] && pixels[1] == column[4]);
+
+   try {
+      plane.subView(nx*ny - 1, 2);
+      CPPUNIT_ASSERT(false);
+   } catch (std::out_of_range &) {
+   }
+}
+
 void st_facilitiesTests::test_Util_file_ok() {
    std::string filename("foo");
    std::remove(filename.c_str());
@@ -262,6 +767,1357 @@ void st_facilitiesTests::test_Util_resolve_fits_files() {
    CPPUNIT_ASSERT(lines.size() == 3);
 }
 
+namespace {
+#ifndef WIN32
+/// Set the modification time of a file to the one in info, plus nsec
+/// nanoseconds modulo one second, so that it stays in the same second.
+   void setModTime(const std::string & filename, const struct stat & info,
+                   long nsec) {
+      struct timespec times[2];
+#ifdef __APPLE__
+      times[0] = info.st_atimespec;
+      times[1] = info.st_mtimespec;
+#else
+      times[0] = info.st_atim;
+      times[1] = info.st_mtim;
+#endif
+      times[1].tv_nsec = (times[1].tv_nsec + nsec) % 1000000000L;
+      CPPUNIT_ASSERT(::utimensat(AT_FDCWD, filename.c_str(), times, 0) == 0);
+   }
+#endif
+}
+
+void st_facilitiesTests::test_Util_isFitsFile() {
+   std::string fitsFile("test_file.fits");
+   std::string header;
+   const char * cards[] = {"SIMPLE  =                    T",
+                           "BITPIX  =                    8",
+                           "NAXIS   =                    0",
+                           "END"};
+   for (size_t i(0); i < 4; i++) {
+      std::string card(cards[i]);
+      header += card + std::string(80 - card.size(), ' ');
+   }
+   header += std::string(2880 - header.size(), ' ');
+   std::ofstream file(fitsFile.c_str());
+   file << header;
+   file.close();
+
+   CPPUNIT_ASSERT(Util::isFitsFile(fitsFile));
+   CPPUNIT_ASSERT(!Util::isFitsFile(m_filename));
+   std::vector<std::string> files;
+   Util::resolve_fits_files(fitsFile, files);
+   CPPUNIT_ASSERT(files.size() == 1 && files[0] == fitsFile);
+
+// Other names for the file give the same result.
+   CPPUNIT_ASSERT(Util::isFitsFile("./" + fitsFile));
+
+#ifndef WIN32
+// A file rewritten in place within the same second, at the same size,
+// is tested again, as is one replaced by another file with the same
+// modification time and size.
+   std::string notFits(2880, 'X');
+   struct stat info;
+   CPPUNIT_ASSERT(::stat(fitsFile.c_str(), &info) == 0);
+   file.open(fitsFile.c_str());
+   file << notFits;
+   file.close();
+   setModTime(fitsFile, info, 10000000);
+   CPPUNIT_ASSERT(!Util::isFitsFile(fitsFile));
+
+   std::string otherFile("test_file_new.fits");
+   file.open(otherFile.c_str());
+   file << header;
+   file.close();
+   CPPUNIT_ASSERT(::stat(fitsFile.c_str(), &info) == 0);
+   setModTime(otherFile, info, 0);
+   CPPUNIT_ASSERT(std::rename(otherFile.c_str(), fitsFile.c_str()) == 0);
+   CPPUNIT_ASSERT(Util::isFitsFile(fitsFile));
+#endif
+
+// A rewritten file of a different size is tested again.
+   file.open(fitsFile.c_str());
+   file << "SIMPLE  =                    T\n";
+   file.close();
+   CPPUNIT_ASSERT(!Util::isFitsFile(fitsFile));
+
+   std::remove(fitsFile.c_str());
+}
+
+void st_facilitiesTests::test_Util_skyDir2pixel() {
+   double crpix[] = {180.5, 90.5};
+   double crval[] = {0, 0};
+   double cdelt[] = {-1, 1};
+   astro::SkyProj proj("AIT", crpix, crval, cdelt, 0, true);
+
+   std::vector<double> lon;
+   std::vector<double> lat;
+   for (size_t k(0); k < 5000; k++) {
+      lon.push_back(5. + 350.*(k % 100)/100.);
+      lat.push_back(-85. + 170.*(k/100)/50.);
+   }
+   size_t npts(lon.size());
+   std::vector<double> ii(npts), jj(npts);
+   Util::skyDir2pixel(proj, &lon[0], &lat[0], &ii[0], &jj[0], npts);
+   std::vector<double> lon2(npts), lat2(npts);
+   Util::pixel2SkyDir(proj, &ii[0], &jj[0], &lon2[0], &lat2[0], npts);
+
+// Compare with the SkyDir interfaces, and check the round trip.
+   double tol(1e-6);
+   for (size_t k(0); k < npts; k++) {
+      double i, j;
+      Util::skyDir2pixel(proj, astro::SkyDir(lon[k], lat[k],
+                                             astro::SkyDir::GALACTIC), i, j);
+      CPPUNIT_ASSERT(std::fabs(i - ii[k]) < tol);
+      CPPUNIT_ASSERT(std::fabs(j - jj[k]) < tol);
+      astro::SkyDir dir;
+      Util::pixel2SkyDir(proj, ii[k], jj[k], dir);
+      CPPUNIT_ASSERT(std::fabs(dir.l() - lon[k]) < tol);
+      CPPUNIT_ASSERT(std::fabs(dir.b() - lat[k]) < tol);
+      CPPUNIT_ASSERT(std::fabs(lon2[k] - lon[k]) < tol);
+      CPPUNIT_ASSERT(std::fabs(lat2[k] - lat[k]) < tol);
+   }
+
+// The multithreaded versions give identical results, with one
+// projection per thread.
+   std::vector<astro::SkyProj *> owned;
+   for (size_t n(0); n < 4; n++) {
+      owned.push_back(new astro::SkyProj("AIT", crpix, crval, cdelt, 0,
+                                         true));
+   }
+   for (size_t nthreads(1); nthreads <= owned.size(); nthreads += 3) {
+      std::vector<const astro::ProjBase *> projs(owned.begin(),
+                                                 owned.begin() + nthreads);
+      std::vector<double> iii(npts), jjj(npts);
+      Util::skyDir2pixel(projs, &lon[0], &lat[0], &iii[0], &jjj[0], npts);
+      CPPUNIT_ASSERT(iii == ii && jjj == jj);
+      std::vector<double> lon3(npts), lat3(npts);
+      Util::pixel2SkyDir(projs, &ii[0], &jj[0], &lon3[0], &lat3[0], npts);
+      CPPUNIT_ASSERT(lon3 == lon2 && lat3 == lat2);
+   }
+   for (size_t n(0); n < owned.size(); n++) {
+      delete owned[n];
+   }
+
+   std::vector<const astro::ProjBase *> none;
+   try {
+      Util::skyDir2pixel(none, &lon[0], &lat[0], &ii[0], &jj[0], npts);
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+}
+
+namespace {
+   void checkFits(int status) {
+      if (status != 0) {
+         char text[FLEN_STATUS];
+         fits_get_errstatus(status, text);
+         CPPUNIT_FAIL(std::string("cfitsio error: ") + text);
+      }
+   }
+
+/// Create a FITS file with an empty primary HDU followed by a binary
+/// table, and return it open at the table.
+   fitsfile * createTable(const std::string & filename,
+                          const std::string & extname,
+                          int ncols, const char * ttype[],
+                          const char * tform[]) {
+      std::remove(filename.c_str());
+      int status(0);
+      fitsfile * fptr(0);
+      fits_create_file(&fptr, filename.c_str(), &status);
+      checkFits(status);
+      fits_create_tbl(fptr, BINARY_TBL, 0, ncols,
+                      const_cast<char **>(ttype), const_cast<char **>(tform),
+                      0, const_cast<char *>(extname.c_str()), &status);
+      checkFits(status);
+      return fptr;
+   }
+
+/// An EVENTS table with a column of each numeric binary table type,
+/// unsigned columns stored with TZERO offsets (U and V), and a vector
+/// column.  TIME is sorted, with each value appearing twice.
+   const int s_nEventCols(9);
+   const char * s_eventCols[] = {"TIME", "ENERGY", "NB", "SH", "EVT", "BIG",
+                                 "U16", "U32", "VEC"};
+   const char * s_eventForms[] = {"1D", "1E", "1B", "1I", "1J", "1K",
+                                  "1U", "1V", "3K"};
+
+   double eventValue(int col, size_t row, size_t elem) {
+      double k(row);
+      switch (col) {
+      case 0:
+         return 100. + (row/2)*0.125;
+      case 1:
+         return 0.25*k;
+      case 2:
+         return row % 256;
+      case 3:
+         return static_cast<double>((row*7) % 30000) - 15000.;
+      case 4:
+         return static_cast<double>((row*100003) % 2000000000) - 1.e9;
+      case 5:
+         return 123456789012.*k - 2.e14;
+      case 6:
+         return (row*37) % 65536;
+      case 7:
+         return 4294967295. - 1000.*k;
+      default:
+         return 3.*k + elem - 5000.;
+      }
+   }
+
+/// Write rows [firstRow, firstRow + nrows) of the EVENTS table.
+   void writeEvents(fitsfile * fptr, size_t firstRow, size_t nrows) {
+      int status(0);
+      for (int col(0); col < s_nEventCols; col++) {
+         size_t repeat(col == s_nEventCols - 1 ? 3 : 1);
+         std::vector<double> values;
+         for (size_t row(firstRow); row < firstRow + nrows; row++) {
+            for (size_t elem(0); elem < repeat; elem++) {
+               values.push_back(eventValue(col, row, elem));
+            }
+         }
+         fits_write_col(fptr, TDOUBLE, col + 1, firstRow + 1, 1,
+                        values.size(), &values[0], &status);
+         checkFits(status);
+      }
+   }
+
+/// @return true if the CHECKSUM and DATASUM keywords of every HDU are
+/// correct according to fits_verify_chksum.
+   bool checksumsOk(const std::string & filename) {
+      int status(0);
+      fitsfile * fptr(0);
+      fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+      checkFits(status);
+      int nhdus(0);
+      fits_get_num_hdus(fptr, &nhdus, &status);
+      bool ok(true);
+      for (int hdu(1); hdu <= nhdus; hdu++) {
+         int hdutype(0), dataok(0), hduok(0);
+         fits_movabs_hdu(fptr, hdu, &hdutype, &status);
+         fits_verify_chksum(fptr, &dataok, &hduok, &status);
+         ok = ok && dataok == 1 && hduok == 1;
+      }
+      fits_close_file(fptr, &status);
+      checkFits(status);
+      return ok;
+   }
+
+   void createEventFile(const std::string & filename, size_t nrows) {
+      fitsfile * fptr(createTable(filename, "EVENTS", s_nEventCols,
+                                  s_eventCols, s_eventForms));
+      writeEvents(fptr, 0, nrows);
+      int status(0);
+      fits_close_file(fptr, &status);
+      checkFits(status);
+   }
+
+/// Read a whole column with fits_read_col, for comparison.
+   std::vector<double> readColumn(const std::string & filename,
+                                  const std::string & extname,
+                                  const std::string & colname) {
+      std::string extfile(filename + "[" + extname + "]");
+      int status(0);
+      fitsfile * fptr(0);
+      fits_open_file(&fptr, extfile.c_str(), READONLY, &status);
+      checkFits(status);
+      int colnum(0);
+      fits_get_colnum(fptr, CASEINSEN, const_cast<char *>(colname.c_str()),
+                      &colnum, &status);
+      int typecode(0);
+      LONGLONG repeat(0), width(0), nrows(0);
+      fits_get_coltypell(fptr, colnum, &typecode, &repeat, &width, &status);
+      fits_get_num_rowsll(fptr, &nrows, &status);
+      checkFits(status);
+      std::vector<double> values(nrows*repeat);
+      if (!values.empty()) {
+         double nulval(0);
+         int anynul(0);
+         fits_read_col(fptr, TDOUBLE, colnum, 1, 1, values.size(), &nulval,
+                       &values[0], &anynul, &status);
+      }
+      fits_close_file(fptr, &status);
+      checkFits(status);
+      return values;
+   }
+}
+
+void st_facilitiesTests::test_FitsTable_getVectorData() {
+   std::string filename("test_table.fits");
+   std::string extname("EFFECTIVE AREA");
+   const char * ttype[] = {"ENERG_LO", "ENERG_HI", "CTHETA_LO", "CTHETA_HI",
+                           "EFFAREA"};
+   const char * tform[] = {"4E", "4E", "3E", "3E", "12E"};
+   long repeat[] = {4, 4, 3, 3, 12};
+   fitsfile * fptr(createTable(filename, extname, 5, ttype, tform));
+   int status(0);
+   for (long row(1); row <= 3; row++) {
+      for (int col(1); col <= 5; col++) {
+         std::vector<float> cell;
+         for (long k(0); k < repeat[col-1]; k++) {
+            cell.push_back(0.1*row + col + 0.37*k);
+         }
+         fits_write_col(fptr, TFLOAT, col, row, 1, cell.size(), &cell[0],
+                        &status);
+      }
+   }
+   fits_close_file(fptr, &status);
+   checkFits(status);
+
+// Compare the cfitsio reader with the tip-based one on every row.
+   std::vector<std::string> fieldNames(ttype, ttype + 5);
+   std::unique_ptr<const tip::Table>
+      table(tip::IFileSvc::instance().readTable(filename, extname));
+   std::vector< std::vector<double> > first;
+   for (size_t nrow(0); nrow < 3; nrow++) {
+      std::vector< std::vector<double> > values;
+      FitsTable::getVectorData(filename, extname, fieldNames, values, nrow);
+      CPPUNIT_ASSERT(values.size() == fieldNames.size());
+      for (size_t i(0); i < fieldNames.size(); i++) {
+         std::vector<double> expected;
+         FitsTable::getVectorData(table.get(), fieldNames[i], expected, nrow);
+         CPPUNIT_ASSERT(values[i].size() == size_t(repeat[i]));
+         CPPUNIT_ASSERT(values[i] == expected);
+      }
+      if (nrow == 0) {
+         first = values;
+      } else {
+         CPPUNIT_ASSERT(values != first);
+      }
+   }
+   table.reset();
+
+// Double precision columns are read at full precision, whereas the
+// tip-based reader rounds them to float.
+   const char * dtype[] = {"ENERG_LO", "SCALE"};
+   const char * dform[] = {"3D", "1D"};
+   fptr = createTable(filename, extname, 2, dtype, dform);
+   double energies[] = {0.1, 1./3., 1e-300};
+   double scale(1. + 1e-12);
+   fits_write_col(fptr, TDOUBLE, 1, 1, 1, 3, energies, &status);
+   fits_write_col(fptr, TDOUBLE, 2, 1, 1, 1, &scale, &status);
+   fits_close_file(fptr, &status);
+   checkFits(status);
+   std::vector<std::string> dnames(dtype, dtype + 2);
+   std::vector< std::vector<double> > dvalues;
+   FitsTable::getVectorData(filename, extname, dnames, dvalues);
+   CPPUNIT_ASSERT(dvalues[0] == std::vector<double>(energies, energies + 3));
+   CPPUNIT_ASSERT(dvalues[1].size() == 1 && dvalues[1][0] == scale);
+   table.reset(tip::IFileSvc::instance().readTable(filename, extname));
+   std::vector<double> rounded;
+   FitsTable::getVectorData(table.get(), "ENERG_LO", rounded);
+   CPPUNIT_ASSERT(rounded.size() == 3);
+   for (size_t k(0); k < 3; k++) {
+      CPPUNIT_ASSERT(rounded[k] == static_cast<float>(energies[k]));
+      CPPUNIT_ASSERT(rounded[k] != energies[k]);
+   }
+   table.reset();
+   std::remove(filename.c_str());
+}
+
+namespace {
+/// Write nrows rows of an EFFECTIVE AREA table with 4 energy bins and
+/// 3 cos(theta) bins, whose values depend on offset and the row.
+   void writeIrfRows(fitsfile * fptr, size_t nrows, double offset) {
+      int status(0);
+      for (size_t row(0); row < nrows; row++) {
+         std::vector<float> elo, ehi, mulo, muhi, aeff;
+         for (size_t k(0); k < 4; k++) {
+            elo.push_back(std::pow(10., 1. + 0.5*k));
+            ehi.push_back(std::pow(10., 1.5 + 0.5*k));
+         }
+         for (size_t i(0); i < 3; i++) {
+            mulo.push_back(0.4 + 0.2*i);
+            muhi.push_back(0.6 + 0.2*i);
+            for (size_t k(0); k < 4; k++) {
+               aeff.push_back(offset + 100.*row + 10.*i + k);
+            }
+         }
+         LONGLONG firstrow(row + 1);
+         fits_write_col(fptr, TFLOAT, 1, firstrow, 1, 4, &elo[0], &status);
+         fits_write_col(fptr, TFLOAT, 2, firstrow, 1, 4, &ehi[0], &status);
+         fits_write_col(fptr, TFLOAT, 3, firstrow, 1, 3, &mulo[0], &status);
+         fits_write_col(fptr, TFLOAT, 4, firstrow, 1, 3, &muhi[0], &status);
+         fits_write_col(fptr, TFLOAT, 5, firstrow, 1, 12, &aeff[0], &status);
+      }
+      checkFits(status);
+   }
+
+   void createIrfFile(const std::string & filename, size_t nrows,
+                      double offset) {
+      const char * ttype[] = {"ENERG_LO", "ENERG_HI", "CTHETA_LO",
+                              "CTHETA_HI", "EFFAREA"};
+      const char * tform[] = {"4E", "4E", "3E", "3E", "12E"};
+      fitsfile * fptr(createTable(filename, "EFFECTIVE AREA", 5, ttype,
+                                  tform));
+      writeIrfRows(fptr, nrows, offset);
+      int status(0);
+      fits_close_file(fptr, &status);
+      checkFits(status);
+   }
+}
+
+void st_facilitiesTests::test_FitsTable_setPar() {
+   std::string filename("test_irf.fits");
+   createIrfFile(filename, 1, 0);
+   FitsTable::clearCache();
+
+// A copy and a second table read through the cache share the data
+// of the first until setPar is called on one of them.
+   FitsTable table(filename, "EFFECTIVE AREA", "EFFAREA");
+   FitsTable copy(table);
+   FitsTable cached(filename, "EFFECTIVE AREA", "EFFAREA");
+   CPPUNIT_ASSERT(&copy.logEnergies() == &table.logEnergies());
+   CPPUNIT_ASSERT(&cached.logEnergies() == &table.logEnergies());
+
+   double logE(table.logEnergies()[1]);
+   double costh(table.costhetas()[1]);
+   double value(table.value(logE, costh));
+   CPPUNIT_ASSERT(value == 11.);
+   CPPUNIT_ASSERT(table.getPar(1, 1) == value);
+   std::vector<double> values;
+   table.getValues(values);
+
+   copy.setPar(1, 1, value + 50.);
+   CPPUNIT_ASSERT(&copy.logEnergies() != &table.logEnergies());
+   CPPUNIT_ASSERT(copy.value(logE, costh) == value + 50.);
+   CPPUNIT_ASSERT(copy.value(logE, costh, false) == value + 50.);
+   CPPUNIT_ASSERT(copy.getPar(1, 1) == value + 50.);
+   CPPUNIT_ASSERT(table.value(logE, costh) == value);
+   CPPUNIT_ASSERT(table.value(logE, costh, false) == value);
+   CPPUNIT_ASSERT(table.getPar(1, 1) == value);
+   CPPUNIT_ASSERT(cached.value(logE, costh) == value);
+   std::vector<double> unchanged;
+   table.getValues(unchanged);
+   CPPUNIT_ASSERT(unchanged == values);
+
+// Nor does modifying a table read through the cache change the
+// cached data.
+   cached.setPar(2, 0, -1.);
+   CPPUNIT_ASSERT(cached.getPar(2, 0) == -1.);
+   FitsTable reread(filename, "EFFECTIVE AREA", "EFFAREA");
+   CPPUNIT_ASSERT(&reread.logEnergies() == &table.logEnergies());
+   CPPUNIT_ASSERT(reread.getPar(2, 0) == 2.);
+   CPPUNIT_ASSERT(table.getPar(2, 0) == 2.);
+
+   FitsTable::clearCache();
+   std::remove(filename.c_str());
+}
+
+namespace {
+   bool sharesData(const FitsTable & a, const FitsTable & b) {
+      return &a.logEnergies() == &b.logEnergies();
+   }
+}
+
+void st_facilitiesTests::test_FitsTable_cache() {
+   std::string filename("test_irf.fits");
+   std::string extname("EFFECTIVE AREA");
+   createIrfFile(filename, 2, 0);
+   FitsTable::clearCache();
+
+// Tables read from the same row of a file, by any name, share the
+// data.
+   FitsTable table(filename, extname, "EFFAREA");
+   FitsTable same(filename, extname, "EFFAREA");
+   FitsTable relative("./" + filename, extname, "EFFAREA");
+   FitsTable row1(filename, extname, "EFFAREA", 1);
+   CPPUNIT_ASSERT(sharesData(same, table) && sharesData(relative, table));
+   CPPUNIT_ASSERT(!sharesData(row1, table));
+   CPPUNIT_ASSERT(table.getPar(0, 0) == 0. && row1.getPar(0, 0) == 100.);
+
+#ifndef WIN32
+// Rewriting the file in place within the same second, at the same
+// size, invalidates its entries through the nanoseconds of the
+// modification time.
+   struct stat info;
+   CPPUNIT_ASSERT(::stat(filename.c_str(), &info) == 0);
+   std::string extfile(filename + "[" + extname + "]");
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_file(&fptr, extfile.c_str(), READWRITE, &status);
+   checkFits(status);
+   writeIrfRows(fptr, 2, 1000.);
+   fits_close_file(fptr, &status);
+   checkFits(status);
+   setModTime(filename, info, 10000000);
+   struct stat rewritten_info;
+   CPPUNIT_ASSERT(::stat(filename.c_str(), &rewritten_info) == 0);
+   CPPUNIT_ASSERT(rewritten_info.st_mtime == info.st_mtime);
+   CPPUNIT_ASSERT(rewritten_info.st_size == info.st_size);
+   CPPUNIT_ASSERT(rewritten_info.st_ino == info.st_ino);
+
+   FitsTable rewritten(filename, extname, "EFFAREA");
+   CPPUNIT_ASSERT(!sharesData(rewritten, table));
+   CPPUNIT_ASSERT(rewritten.getPar(0, 0) == 1000.);
+   CPPUNIT_ASSERT(table.getPar(0, 0) == 0.);
+
+// Replacing it by another file with the same modification time and
+// size does too, through the inode.
+   std::string other("test_irf_new.fits");
+   createIrfFile(other, 2, 2000.);
+   CPPUNIT_ASSERT(::stat(filename.c_str(), &info) == 0);
+   setModTime(other, info, 0);
+   CPPUNIT_ASSERT(std::rename(other.c_str(), filename.c_str()) == 0);
+   FitsTable replaced(filename, extname, "EFFAREA");
+   CPPUNIT_ASSERT(!sharesData(replaced, rewritten));
+   CPPUNIT_ASSERT(replaced.getPar(0, 0) == 2000.);
+#endif
+
+// Find the size of one table in the cache, as the smallest budget
+// with which it is cached.
+   size_t tooSmall(0), bytes(1 << 20);
+   while (tooSmall + 1 < bytes) {
+      size_t budget((tooSmall + bytes)/2);
+      FitsTable::clearCache();
+      FitsTable::setCacheBudget(budget);
+      FitsTable first(filename, extname, "EFFAREA");
+      FitsTable second(filename, extname, "EFFAREA");
+      if (sharesData(first, second)) {
+         bytes = budget;
+      } else {
+         tooSmall = budget;
+      }
+   }
+   CPPUNIT_ASSERT(bytes > 1 && bytes < (1 << 20));
+
+// The least recently used table is evicted when the budget is
+// exceeded, either by a new table or by lowering the budget.
+   FitsTable::clearCache();
+   FitsTable::setCacheBudget(2*bytes - 1);
+   FitsTable older(filename, extname, "EFFAREA", 0);
+   FitsTable newer(filename, extname, "EFFAREA", 1);
+   CPPUNIT_ASSERT(sharesData(FitsTable(filename, extname, "EFFAREA", 1),
+                             newer));
+   CPPUNIT_ASSERT(!sharesData(FitsTable(filename, extname, "EFFAREA", 0),
+                              older));
+
+   FitsTable::clearCache();
+   FitsTable::setCacheBudget(2*bytes);
+   FitsTable first(filename, extname, "EFFAREA", 0);
+   FitsTable second(filename, extname, "EFFAREA", 1);
+   CPPUNIT_ASSERT(sharesData(FitsTable(filename, extname, "EFFAREA", 0),
+                             first));
+   FitsTable::setCacheBudget(2*bytes - 1);
+   CPPUNIT_ASSERT(sharesData(FitsTable(filename, extname, "EFFAREA", 0),
+                             first));
+   CPPUNIT_ASSERT(!sharesData(FitsTable(filename, extname, "EFFAREA", 1),
+                              second));
+
+// A budget of zero disables caching.
+   FitsTable::setCacheBudget(0);
+   FitsTable uncached(filename, extname, "EFFAREA");
+   CPPUNIT_ASSERT(!sharesData(FitsTable(filename, extname, "EFFAREA"),
+                              uncached));
+
+// Restore the default budget.
+   FitsTable::setCacheBudget(64*1024*1024);
+   FitsTable::clearCache();
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsUtil_getTableVector() {
+   std::string filename("test_events.fits");
+   size_t nrows(3000);
+   createEventFile(filename, nrows);
+
+   for (int col(0); col < s_nEventCols; col++) {
+      std::vector<double> expected(readColumn(filename, "EVENTS",
+                                              s_eventCols[col]));
+      size_t repeat(col == s_nEventCols - 1 ? 3 : 1);
+      CPPUNIT_ASSERT(expected.size() == nrows*repeat);
+      std::vector<double> values;
+      FitsUtil::getTableVector(filename, "EVENTS", s_eventCols[col], values);
+      CPPUNIT_ASSERT(values == expected);
+
+// Read in blocks of 700 rows, the last one partial.
+      std::vector<double> chunked;
+      size_t next(0);
+      FitsUtil::readColumnChunks(filename, "EVENTS", s_eventCols[col],
+                                 [&](size_t firstRow, size_t n,
+                                     size_t repeat, const double * data) {
+         CPPUNIT_ASSERT(firstRow == next && n <= 700);
+         next += n;
+         chunked.insert(chunked.end(), data, data + n*repeat);
+      }, 700);
+      CPPUNIT_ASSERT(next == nrows);
+      CPPUNIT_ASSERT(chunked == expected);
+   }
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsUtil_getTableColumns() {
+   std::string filename("test_events.fits");
+   size_t nrows(3000);
+   createEventFile(filename, nrows);
+
+   std::vector<std::string> names(s_eventCols, s_eventCols + s_nEventCols);
+   std::vector< std::vector<double> > expected;
+   for (size_t k(0); k < names.size(); k++) {
+      expected.push_back(readColumn(filename, "EVENTS", names[k]));
+   }
+// The raw rows are decoded on one, several and all hardware threads.
+   size_t nthreads[] = {1, 3, 0};
+   for (size_t i(0); i < 3; i++) {
+      std::vector< std::vector<double> > columns;
+      FitsUtil::getTableColumns(filename, "EVENTS", names, columns,
+                                nthreads[i]);
+      CPPUNIT_ASSERT(columns == expected);
+   }
+   std::remove(filename.c_str());
+}
+
+namespace {
+/// The ranges of consecutive selected rows.
+   FitsUtil::RowRanges toRanges(const std::vector<bool> & selected) {
+      FitsUtil::RowRanges ranges;
+      for (size_t row(0); row < selected.size(); row++) {
+         if (!selected[row]) {
+            continue;
+         }
+         if (!ranges.empty() && ranges.back().second == row) {
+            ranges.back().second++;
+         } else {
+            ranges.push_back(std::make_pair(row, row + 1));
+         }
+      }
+      return ranges;
+   }
+}
+
+void st_facilitiesTests::test_FitsUtil_rowRanges() {
+   std::string filename("test_events.fits");
+   size_t nrows(3000);
+   createEventFile(filename, nrows);
+
+   std::vector<std::string> names(s_eventCols, s_eventCols + s_nEventCols);
+   std::vector< std::vector<double> > all;
+   for (size_t k(0); k < names.size(); k++) {
+      all.push_back(readColumn(filename, "EVENTS", names[k]));
+   }
+
+   FitsUtil::RowRanges ranges;
+   ranges.push_back(std::make_pair(10, 20));
+   ranges.push_back(std::make_pair(1500, 2600));
+   ranges.push_back(std::make_pair(2990, 3000));
+   std::vector< std::vector<double> > columns;
+   FitsUtil::getTableColumns(filename, "EVENTS", names, ranges, columns, 2);
+   for (size_t k(0); k < names.size(); k++) {
+      size_t repeat(all[k].size()/nrows);
+      std::vector<double> expected;
+      for (size_t i(0); i < ranges.size(); i++) {
+         expected.insert(expected.end(),
+                         all[k].begin() + ranges[i].first*repeat,
+                         all[k].begin() + ranges[i].second*repeat);
+      }
+      CPPUNIT_ASSERT(columns[k] == expected);
+      std::vector<double> values;
+      FitsUtil::getTableVector(filename, "EVENTS", names[k], ranges, values);
+      CPPUNIT_ASSERT(values == expected);
+   }
+
+   std::vector<bool> selected(nrows);
+   for (size_t row(0); row < nrows; row++) {
+      selected[row] = eventValue(2, row, 0) < 10;
+   }
+   FitsUtil::findRows(filename, "EVENTS", "NB < 10", ranges);
+   CPPUNIT_ASSERT(ranges == toRanges(selected));
+
+   std::vector< std::pair<double, double> > intervals;
+   intervals.push_back(std::make_pair(150., 160.));
+   intervals.push_back(std::make_pair(100.5, 101.));
+   for (size_t row(0); row < nrows; row++) {
+      double time(eventValue(0, row, 0));
+      selected[row] = ((time >= 100.5 && time <= 101.) ||
+                       (time >= 150. && time <= 160.));
+   }
+   FitsUtil::findSortedRows(filename, "EVENTS", "TIME", intervals, ranges);
+   CPPUNIT_ASSERT(ranges == toRanges(selected));
+
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsUtil_getRecordVectors() {
+   std::string filename("test_events.fits");
+   size_t nrows(3000);
+   createEventFile(filename, nrows);
+   std::vector<double> all(readColumn(filename, "EVENTS", "VEC"));
+
+   std::vector<size_t> recordNums;
+   recordNums.push_back(2999);
+   recordNums.push_back(0);
+   recordNums.push_back(1234);
+   std::vector< std::vector<double> > cells;
+   FitsUtil::getRecordVectors(filename, "EVENTS", "VEC", recordNums, cells);
+   CPPUNIT_ASSERT(cells.size() == recordNums.size());
+   for (size_t i(0); i < recordNums.size(); i++) {
+      std::vector<double> expected(all.begin() + 3*recordNums[i],
+                                   all.begin() + 3*(recordNums[i] + 1));
+      CPPUNIT_ASSERT(cells[i] == expected);
+      std::vector<double> cell;
+      FitsUtil::getRecordVector(filename, "EVENTS", "VEC", cell,
+                                recordNums[i]);
+      CPPUNIT_ASSERT(cell == expected);
+   }
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsUtil_writeChecksums() {
+// The table is large enough for the data sums to be split among
+// threads.
+   std::string filename("test_events.fits");
+   createEventFile(filename, 60000);
+   CPPUNIT_ASSERT(!checksumsOk(filename));
+   size_t nthreads[] = {1, 4};
+   for (size_t i(0); i < 2; i++) {
+      FitsUtil::writeChecksums(filename, nthreads[i]);
+      CPPUNIT_ASSERT(checksumsOk(filename));
+   }
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsUtil_updateChecksums() {
+   std::string filename("test_events.fits");
+   size_t nrows(3000);
+   createEventFile(filename, nrows);
+   FitsUtil::writeChecksums(filename);
+   CPPUNIT_ASSERT(checksumsOk(filename));
+
+// Append rows, which invalidates the checksums of the table.
+   size_t nappend(1001);
+   std::string extfile(filename + "[EVENTS]");
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_file(&fptr, extfile.c_str(), READWRITE, &status);
+   checkFits(status);
+   writeEvents(fptr, nrows, nappend);
+   fits_close_file(fptr, &status);
+   checkFits(status);
+   CPPUNIT_ASSERT(!checksumsOk(filename));
+
+   FitsUtil::updateChecksums(filename, "EVENTS", nrows);
+   CPPUNIT_ASSERT(checksumsOk(filename));
+   CPPUNIT_ASSERT(readColumn(filename, "EVENTS", "TIME").size() ==
+                  nrows + nappend);
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsUtil_filterCopy() {
+// Enough rows for several blocks of rows to be filtered.
+   std::string filename("test_events.fits");
+   size_t nrows(140000);
+   createEventFile(filename, nrows);
+   std::string filter("NB < 100 && U16 > 30000");
+
+// fcopy applies the filter with fits_copy_file.
+   std::string expectedFile("test_events_fcopy.fits");
+   FitsUtil::fcopy(filename, expectedFile, "EVENTS", filter, true);
+   std::vector< std::vector<double> > expected;
+   for (int col(0); col < s_nEventCols; col++) {
+      expected.push_back(readColumn(expectedFile, "EVENTS", s_eventCols[col]));
+   }
+   CPPUNIT_ASSERT(!expected[0].empty() && expected[0].size() < nrows);
+
+   std::string outfile("test_events_filtered.fits");
+   size_t nthreads[] = {1, 2};
+   for (size_t i(0); i < 2; i++) {
+      size_t rowsDone(0);
+      FitsUtil::filterCopy(filename, outfile, "EVENTS", filter, true,
+                           [&](size_t done, size_t total, double) {
+                              CPPUNIT_ASSERT(done > rowsDone && total == nrows);
+                              rowsDone = done;
+                           }, nthreads[i]);
+      CPPUNIT_ASSERT(rowsDone == nrows);
+      for (int col(0); col < s_nEventCols; col++) {
+         CPPUNIT_ASSERT(readColumn(outfile, "EVENTS", s_eventCols[col])
+                        == expected[col]);
+      }
+   }
+   std::remove(outfile.c_str());
+   std::remove(expectedFile.c_str());
+   std::remove(filename.c_str());
+}
+
+namespace {
+/// Write a table of TIME values, with VAL and the vector column VEC
+/// identifying the file and row of each value.  The elements of VEC
+/// after the first are minus VAL.
+   void writeTimes(const std::string & filename, size_t file,
+                   const std::vector<double> & times, size_t vecRepeat=2) {
+      std::ostringstream format;
+      format << vecRepeat << "D";
+      std::string vecForm(format.str());
+      const char * ttype[] = {"TIME", "VAL", "VEC"};
+      const char * tform[] = {"1D", "1J", vecForm.c_str()};
+      fitsfile * fptr(createTable(filename, "EVENTS", 3, ttype, tform));
+      std::vector<double> val, vec;
+      for (size_t row(0); row < times.size(); row++) {
+         val.push_back(100*file + row);
+         vec.push_back(val.back());
+         for (size_t elem(1); elem < vecRepeat; elem++) {
+            vec.push_back(-val.back());
+         }
+      }
+      int status(0);
+      fits_write_col(fptr, TDOUBLE, 1, 1, 1, times.size(),
+                     const_cast<double *>(&times[0]), &status);
+      fits_write_col(fptr, TDOUBLE, 2, 1, 1, val.size(), &val[0], &status);
+      fits_write_col(fptr, TDOUBLE, 3, 1, 1, vec.size(), &vec[0], &status);
+      fits_close_file(fptr, &status);
+      checkFits(status);
+   }
+
+   class TimeLess {
+   public:
+      bool operator()(const std::pair<double, double> & a,
+                      const std::pair<double, double> & b) const {
+         return a.first < b.first;
+      }
+   };
+}
+
+void st_facilitiesTests::test_MultiFileTable() {
+// Two sorted tables with interleaved and tied values, and an unsorted
+// one.
+   double times[3][4] = {{1, 2, 2, 4}, {2, 3, 4, 5}, {4, 0.5, 2, 2}};
+   std::vector<std::string> files;
+   std::vector< std::pair<double, double> > rows;
+   for (size_t i(0); i < 3; i++) {
+      std::ostringstream filename;
+      filename << "test_times_" << i << ".fits";
+      files.push_back(filename.str());
+      std::vector<double> values(times[i], times[i] + 4);
+      writeTimes(files.back(), i, values);
+      for (size_t row(0); row < values.size(); row++) {
+         rows.push_back(std::make_pair(values[row], 100.*i + row));
+      }
+   }
+// Rows with equal times keep their file order, then their row order.
+   std::stable_sort(rows.begin(), rows.end(), TimeLess());
+
+   std::vector<std::string> names;
+   names.push_back("VEC");
+   names.push_back("TIME");
+   names.push_back("VAL");
+   MultiFileTable::Columns columns;
+   MultiFileTable(files, "EVENTS", names, 2).readMerged("TIME", columns);
+   CPPUNIT_ASSERT(columns.size() == 3 && columns[1].size() == rows.size());
+   CPPUNIT_ASSERT(columns[0].size() == 2*rows.size());
+   for (size_t k(0); k < rows.size(); k++) {
+      CPPUNIT_ASSERT(columns[1][k] == rows[k].first);
+      CPPUNIT_ASSERT(columns[2][k] == rows[k].second);
+      CPPUNIT_ASSERT(columns[0][2*k] == rows[k].second);
+      CPPUNIT_ASSERT(columns[0][2*k + 1] == -rows[k].second);
+   }
+
+   try {
+      MultiFileTable(files, "EVENTS", names).readMerged("VEC", columns);
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+
+// Tables whose vector columns differ in size cannot be merged, whether
+// the wider one comes first or last.
+   std::string wider("test_times_wide.fits");
+   writeTimes(wider, 3, std::vector<double>(times[1], times[1] + 4), 3);
+   std::vector<std::string> widerLast(files);
+   widerLast.push_back(wider);
+   std::vector<std::string> widerFirst(1, wider);
+   widerFirst.insert(widerFirst.end(), files.begin(), files.end());
+   try {
+      MultiFileTable(widerLast, "EVENTS", names).readMerged("TIME", columns);
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+   try {
+      MultiFileTable(widerFirst, "EVENTS", names).readMerged("TIME", columns);
+      CPPUNIT_ASSERT(false);
+   } catch (std::invalid_argument &) {
+   }
+// The wide table alone merges, with its own shape.
+   MultiFileTable(std::vector<std::string>(1, wider), "EVENTS",
+                  names).readMerged("TIME", columns);
+   CPPUNIT_ASSERT(columns[1] == std::vector<double>(times[1], times[1] + 4));
+   CPPUNIT_ASSERT(columns[0].size() == 12);
+   CPPUNIT_ASSERT(columns[0][3] == 301. && columns[0][5] == -301.);
+   std::remove(wider.c_str());
+
+// An unreadable file is reported by next(), and the files after it
+// are still read.
+   std::vector<std::string> withMissing(files);
+   withMissing.insert(withMissing.begin() + 1, "test_times_missing.fits");
+   MultiFileTable table(withMissing, "EVENTS", names);
+   CPPUNIT_ASSERT(table.next(columns) && table.fileIndex() == 0);
+   try {
+      table.next(columns);
+      CPPUNIT_ASSERT(false);
+   } catch (std::runtime_error &) {
+   }
+   CPPUNIT_ASSERT(table.next(columns) && table.fileIndex() == 2);
+   CPPUNIT_ASSERT(columns[1] == std::vector<double>(times[1], times[1] + 4));
+   CPPUNIT_ASSERT(table.next(columns) && table.fileIndex() == 3);
+   CPPUNIT_ASSERT(!table.next(columns));
+
+   for (size_t i(0); i < files.size(); i++) {
+      std::remove(files[i].c_str());
+   }
+}
+
+namespace {
+/// Write the WCS keywords of a sky map in Galactic coordinates.
+   void writeWcs(fitsfile * fptr, const std::string & proj,
+                 double crpix1, double crpix2, double cdelt1, double cdelt2,
+                 double crval1=0, double crval2=0) {
+      std::string ctype1("GLON-" + proj);
+      std::string ctype2("GLAT-" + proj);
+      int status(0);
+      fits_write_key(fptr, TSTRING, "CTYPE1",
+                     const_cast<char *>(ctype1.c_str()), 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CRPIX1", &crpix1, 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CRVAL1", &crval1, 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CDELT1", &cdelt1, 0, &status);
+      fits_write_key(fptr, TSTRING, "CTYPE2",
+                     const_cast<char *>(ctype2.c_str()), 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CRPIX2", &crpix2, 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CRVAL2", &crval2, 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CDELT2", &cdelt2, 0, &status);
+      checkFits(status);
+   }
+
+/// Create a primary image with the given raw pixel values.  BSCALE,
+/// BZERO and, for integer images with blank >= 0, BLANK are written
+/// after the pixels, so that the pixels are stored unscaled.
+   fitsfile * createImage(const std::string & filename, int bitpix,
+                          const std::vector<long> & naxes,
+                          const std::vector<double> & raw,
+                          double bscale=1, double bzero=0,
+                          long long blank=-1) {
+      std::remove(filename.c_str());
+      int status(0);
+      fitsfile * fptr(0);
+      fits_create_file(&fptr, filename.c_str(), &status);
+      fits_create_img(fptr, bitpix, naxes.size(),
+                      const_cast<long *>(&naxes[0]), &status);
+      fits_write_img(fptr, TDOUBLE, 1, raw.size(),
+                     const_cast<double *>(&raw[0]), &status);
+      if (bscale != 1 || bzero != 0) {
+         fits_write_key(fptr, TDOUBLE, "BSCALE", &bscale, 0, &status);
+         fits_write_key(fptr, TDOUBLE, "BZERO", &bzero, 0, &status);
+      }
+      if (bitpix > 0 && blank >= 0) {
+         fits_write_key(fptr, TLONGLONG, "BLANK", &blank, 0, &status);
+      }
+      checkFits(status);
+      return fptr;
+   }
+
+   void closeFits(fitsfile * fptr) {
+      int status(0);
+      fits_close_file(fptr, &status);
+      checkFits(status);
+   }
+
+/// @return true if the values are equal, or both NaN.
+   bool sameValues(const std::vector<double> & a,
+                   const std::vector<double> & b) {
+      if (a.size() != b.size()) {
+         return false;
+      }
+      for (size_t k(0); k < a.size(); k++) {
+         if (!(a[k] == b[k] || (std::isnan(a[k]) && std::isnan(b[k])))) {
+            return false;
+         }
+      }
+      return true;
+   }
+}
+
+void st_facilitiesTests::test_FitsImage_loadModes() {
+   std::string filename("test_image.fits");
+   std::vector<long> naxes;
+   naxes.push_back(7);
+   naxes.push_back(5);
+   size_t npix(35);
+// Scalings whose results are not exactly representable as floats.
+   int bitpix[] = {8, 16, 32, -32, -64};
+   double bscale[] = {1, 0.1, 2.5e-3, 1.5, 1};
+   double bzero[] = {-128, 3.3, 1e5, -0.25, 0};
+   for (size_t n(0); n < 5; n++) {
+      std::vector<double> raw;
+      for (size_t k(0); k < npix; k++) {
+         switch (bitpix[n]) {
+         case 8:
+            raw.push_back((k*37) % 256);
+            break;
+         case 16:
+            raw.push_back(static_cast<double>((k*1031) % 65536) - 32768.);
+            break;
+         case 32:
+            raw.push_back(k*100000007. - 1.7e9);
+            break;
+         case -32:
+            raw.push_back(static_cast<float>(0.1*k - 1.3));
+            break;
+         default:
+            raw.push_back(0.1*k - 1.3);
+         }
+      }
+// Pixel 3 is undefined: BLANK for integer images, NaN otherwise.
+      long long blank(-1);
+      if (bitpix[n] > 0) {
+         blank = static_cast<long long>(raw[3]);
+      } else {
+         raw[3] = std::numeric_limits<double>::quiet_NaN();
+      }
+      std::vector<double> expected;
+      for (size_t k(0); k < npix; k++) {
+         expected.push_back(static_cast<float>(bscale[n]*raw[k] + bzero[n]));
+      }
+      expected[3] = std::numeric_limits<double>::quiet_NaN();
+      fitsfile * fptr(createImage(filename, bitpix[n], naxes, raw, bscale[n],
+                                  bzero[n], blank));
+      writeWcs(fptr, "CAR", 4, 3, -1, 1);
+      closeFits(fptr);
+
+      FitsImage read(filename);
+      FitsImage mapped(filename, "", FitsImage::MEMORY_MAP);
+      FitsImage onDemand(filename, "", FitsImage::ON_DEMAND);
+      CPPUNIT_ASSERT(!read.imageView().isMapped());
+      CPPUNIT_ASSERT(read.imageData().size() == npix);
+      CPPUNIT_ASSERT(mapped.imageView().isMapped());
+      CPPUNIT_ASSERT(mapped.imageData().empty());
+      std::vector<double> values;
+      read.getImageData(values);
+      CPPUNIT_ASSERT(sameValues(values, expected));
+      mapped.getImageData(values);
+      CPPUNIT_ASSERT(sameValues(values, expected));
+      onDemand.getImageData(values);
+      CPPUNIT_ASSERT(sameValues(values, expected));
+
+// Rows of the mapped image, decoded on access.
+      ImageView view(mapped.imageView());
+      for (size_t j(0); j < 5; j++) {
+         std::vector<double> row;
+         view.subView(7*j, 7).get(row);
+         CPPUNIT_ASSERT(sameValues(row, std::vector<double>
+                                   (expected.begin() + 7*j,
+                                    expected.begin() + 7*(j + 1))));
+      }
+   }
+   std::remove(filename.c_str());
+
+// A gzip'd file cannot be mapped, so it is read instead.
+   std::string gzfile("test_image.fits.gz");
+   std::vector<double> raw, expected;
+   for (size_t k(0); k < npix; k++) {
+      raw.push_back(static_cast<double>(k) - 10.);
+      expected.push_back(static_cast<float>(0.1*raw.back() + 3.3));
+   }
+   fitsfile * fptr(createImage(gzfile, 16, naxes, raw, 0.1, 3.3));
+   writeWcs(fptr, "CAR", 4, 3, -1, 1);
+   closeFits(fptr);
+   FitsImage fallback(gzfile, "", FitsImage::MEMORY_MAP);
+   CPPUNIT_ASSERT(!fallback.imageView().isMapped());
+   CPPUNIT_ASSERT(fallback.imageData().size() == npix);
+   std::vector<double> values;
+   fallback.getImageData(values);
+   CPPUNIT_ASSERT(values == expected);
+   std::remove(gzfile.c_str());
+}
+
+namespace {
+/// Write the keywords of a third, non-celestial axis.
+   void writeEnergyAxis(fitsfile * fptr) {
+      double crval3(100), cdelt3(1), crpix3(1);
+      int status(0);
+      fits_write_key(fptr, TSTRING, "CTYPE3", const_cast<char *>("Energy"),
+                     0, &status);
+      fits_write_key(fptr, TDOUBLE, "CRVAL3", &crval3, 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CDELT3", &cdelt3, 0, &status);
+      fits_write_key(fptr, TDOUBLE, "CRPIX3", &crpix3, 0, &status);
+      checkFits(status);
+   }
+
+   std::vector<double> cubeValues(size_t npix, double offset) {
+      std::vector<double> values;
+      for (size_t k(0); k < npix; k++) {
+         values.push_back(offset + 0.5*k);
+      }
+      return values;
+   }
+
+   std::vector<double> planeValues(const ImageView & plane) {
+      std::vector<double> values;
+      plane.get(values);
+      return values;
+   }
+}
+
+void st_facilitiesTests::test_FitsImage_plane() {
+   std::string filename("test_cube.fits");
+   std::vector<long> naxes;
+   naxes.push_back(4);
+   naxes.push_back(3);
+   naxes.push_back(3);
+   size_t npix(12);
+   std::vector<double> original(cubeValues(3*npix, 0));
+   fitsfile * fptr(createImage(filename, -32, naxes, original));
+   writeWcs(fptr, "CAR", 2.5, 2, -1, 1);
+   writeEnergyAxis(fptr);
+   closeFits(fptr);
+
+   std::vector<std::vector<double> > slices;
+   for (size_t k(0); k < 3; k++) {
+      slices.push_back(std::vector<double>(original.begin() + k*npix,
+                                           original.begin() + (k + 1)*npix));
+   }
+
+// Each plane, read on demand, matches the slice of the image read in
+// READ mode.
+   FitsImage cube(filename);
+   FitsImage lazy(filename, "", FitsImage::ON_DEMAND);
+   CPPUNIT_ASSERT(cube.numPlanes() == 3 && lazy.numPlanes() == 3);
+   CPPUNIT_ASSERT(lazy.imageData().empty());
+   std::vector<double> values;
+   cube.getImageData(values);
+   CPPUNIT_ASSERT(values == original);
+   for (size_t k(0); k < 3; k++) {
+      CPPUNIT_ASSERT(planeValues(cube.plane(k)) == slices[k]);
+      CPPUNIT_ASSERT(planeValues(lazy.plane(k)) == slices[k]);
+   }
+   try {
+      lazy.plane(3);
+      CPPUNIT_ASSERT(false);
+   } catch (std::out_of_range &) {
+   }
+
+// With room for one plane, only the most recently used plane is
+// cached.  Whether a plane is cached is seen by rewriting the file:
+// cached planes keep their old values.
+   lazy.setPlaneCacheSize(1);
+   lazy.plane(0);
+   ImageView plane1(lazy.plane(1));
+
+// A copy has its own cache.
+   FitsImage copy(lazy);
+   copy.setPlaneCacheSize(0);
+   CPPUNIT_ASSERT(planeValues(copy.plane(2)) == slices[2]);
+
+   std::vector<double> rewritten(cubeValues(3*npix, 1000.));
+   int status(0);
+   fits_open_file(&fptr, filename.c_str(), READWRITE, &status);
+   fits_write_img(fptr, TDOUBLE, 1, rewritten.size(), &rewritten[0],
+                  &status);
+   checkFits(status);
+   closeFits(fptr);
+   std::vector<double> newSlice1(rewritten.begin() + npix,
+                                 rewritten.begin() + 2*npix);
+
+   CPPUNIT_ASSERT(planeValues(lazy.plane(1)) == slices[1]);
+   CPPUNIT_ASSERT(planeValues(lazy.plane(0)) ==
+                  std::vector<double>(rewritten.begin(),
+                                      rewritten.begin() + npix));
+   CPPUNIT_ASSERT(planeValues(lazy.plane(1)) == newSlice1);
+   CPPUNIT_ASSERT(planeValues(copy.plane(1)) == newSlice1);
+
+// A view remains valid after its plane is dropped from the cache.
+   CPPUNIT_ASSERT(planeValues(plane1) == slices[1]);
+
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsImage_projection() {
+   std::string filename("test_image.fits");
+   std::vector<long> naxes;
+   naxes.push_back(10);
+   naxes.push_back(8);
+   std::vector<double> raw(80, 1.);
+
+// The projection built from the keywords read with the image matches
+// the one wcslib builds from the file.
+   const char * projections[] = {"AIT", "TAN"};
+   for (size_t n(0); n < 2; n++) {
+      fitsfile * fptr(createImage(filename, -32, naxes, raw));
+      writeWcs(fptr, projections[n], 5.5, 4, -2, 2, 30, 20);
+      closeFits(fptr);
+
+      FitsImage image(filename);
+      astro::SkyProj reference(filename);
+      std::unique_ptr<astro::SkyProj>
+         created(FitsImage::skyProjCreate(filename));
+      std::vector<double> lon, lat;
+      image.getCelestialArrays(lon, lat);
+      CPPUNIT_ASSERT(lon.size() == 80 && lat.size() == 80);
+      for (size_t j(0); j < 8; j++) {
+         for (size_t i(0); i < 10; i++) {
+            std::pair<double, double> dir(reference.pix2sph(i + 1, j + 1));
+            std::pair<double, double> other(created->pix2sph(i + 1, j + 1));
+            CPPUNIT_ASSERT(std::fabs(lon[i + 10*j] - dir.first) < 1e-10);
+            CPPUNIT_ASSERT(std::fabs(lat[i + 10*j] - dir.second) < 1e-10);
+            CPPUNIT_ASSERT(std::fabs(other.first - dir.first) < 1e-10);
+            CPPUNIT_ASSERT(std::fabs(other.second - dir.second) < 1e-10);
+         }
+      }
+   }
+
+// An image without WCS keywords loads, but has no projection.
+   closeFits(createImage(filename, -32, naxes, raw));
+   FitsImage image(filename);
+   std::vector<std::string> names;
+   image.getAxisNames(names);
+   CPPUNIT_ASSERT(names.size() == 2 && names[0] == "" && names[1] == "");
+   std::vector<double> values;
+   image.getImageData(values);
+   CPPUNIT_ASSERT(values == raw);
+   std::vector<double> lon, lat, solidAngles;
+   try {
+      image.getCelestialArrays(lon, lat);
+      CPPUNIT_ASSERT(false);
+   } catch (std::runtime_error &) {
+   }
+   try {
+      image.getSolidAngles(solidAngles);
+      CPPUNIT_ASSERT(false);
+   } catch (std::runtime_error &) {
+   }
+   try {
+      image.getRowSolidAngles(solidAngles);
+      CPPUNIT_ASSERT(false);
+   } catch (std::runtime_error &) {
+   }
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsImage_getSolidAngles() {
+   std::string filename("test_image.fits");
+   size_t nx(30), ny(40);
+   std::vector<long> naxes;
+   naxes.push_back(nx);
+   naxes.push_back(ny);
+   std::vector<double> raw(nx*ny, 1.);
+
+   const char * projections[] = {"AIT", "TAN"};
+   double cdelt[] = {2, 1};
+   for (size_t n(0); n < 2; n++) {
+      fitsfile * fptr(createImage(filename, -32, naxes, raw));
+      writeWcs(fptr, projections[n], 15.5, 20.5, -cdelt[n], cdelt[n],
+               30, 20);
+      closeFits(fptr);
+
+// The solid angles computed pixel by pixel from the directions of
+// its four corners.  NB: wcslib pixel indices start at 1.
+      std::unique_ptr<astro::SkyProj>
+         proj(FitsImage::skyProjCreate(filename));
+      std::vector<double> expected;
+      for (size_t j(1); j < ny + 1; j++) {
+         for (size_t i(1); i < nx + 1; i++) {
+            astro::SkyDir A(i - 0.5, j - 0.5, *proj);
+            astro::SkyDir B(i + 0.5, j - 0.5, *proj);
+            astro::SkyDir C(i + 0.5, j + 0.5, *proj);
+            astro::SkyDir D(i - 0.5, j + 0.5, *proj);
+            expected.push_back(FitsImage::solidAngle(A, B, C, D));
+         }
+      }
+
+      FitsImage image(filename);
+      std::vector<double> rowSolidAngles;
+      CPPUNIT_ASSERT(!image.getRowSolidAngles(rowSolidAngles));
+      std::vector<double> solidAngles;
+      image.getSolidAngles(solidAngles);
+      CPPUNIT_ASSERT(solidAngles == expected);
+      size_t nthreads[] = {1, 3, 4, 0};
+      for (size_t k(0); k < 4; k++) {
+         image.getSolidAngles(solidAngles, nthreads[k]);
+         CPPUNIT_ASSERT(solidAngles == expected);
+      }
+   }
+   std::remove(filename.c_str());
+}
+
+void st_facilitiesTests::test_FitsImage_getRowSolidAngles() {
+   std::string filename("test_image.fits");
+   double pi(std::acos(-1.));
+   double degToRad(pi/180.);
+
+// All-sky maps of 10 degree wide columns: a CAR map whose rows end at
+// the poles, one whose rows extend past them and are clamped there,
+// and a CEA map.
+   const char * projections[] = {"CAR", "CAR", "CEA"};
+   size_t nrows[] = {180, 260, 100};
+   double cdelt2[] = {1, 0.7, 360./pi/100.};
+   size_t nx(36);
+   for (size_t n(0); n < 3; n++) {
+      size_t ny(nrows[n]);
+      std::vector<long> naxes;
+      naxes.push_back(nx);
+      naxes.push_back(ny);
+      std::vector<double> raw(nx*ny, 1.);
+      fitsfile * fptr(createImage(filename, -32, naxes, raw));
+      double crpix2(0.5*(ny + 1));
+      writeWcs(fptr, projections[n], 18.5, crpix2, -10, cdelt2[n]);
+      closeFits(fptr);
+
+// The exact area of the band of each row, with the latitudes of its
+// edges from wcslib, away from the poles.
+      std::unique_ptr<astro::SkyProj>
+         proj(FitsImage::skyProjCreate(filename));
+      std::vector<double> sinb;
+      for (size_t j(0); j < ny + 1; j++) {
+         double y(j + 0.5);
+         double b((y - crpix2)*cdelt2[n]);
+         if (n == 2) {
+            b = std::asin(std::max(-1., std::min(1., b*degToRad)))/degToRad;
+         }
+         if (std::fabs(b) < 89.9) {
+            b = proj->pix2sph(18.5, y).second;
+         } else {
+            b = b > 0 ? 90. : -90.;
+         }
+         sinb.push_back(std::sin(b*degToRad));
+      }
+
+      FitsImage image(filename);
+      std::vector<double> rowSolidAngles;
+      CPPUNIT_ASSERT(image.getRowSolidAngles(rowSolidAngles));
+      CPPUNIT_ASSERT(rowSolidAngles.size() == ny);
+      double total(0);
+      for (size_t j(0); j < ny; j++) {
+         double expected(10.*degToRad*(sinb[j + 1] - sinb[j]));
+         CPPUNIT_ASSERT(std::fabs(rowSolidAngles[j] - expected) 
+                        < 1e-12*std::fabs(expected) + 1e-15);
+         total += nx*rowSolidAngles[j];
+      }
+      CPPUNIT_ASSERT(std::fabs(total - 4.*pi) < 1e-12);
+      if (n == 1) {
+// The rows past the poles are empty.
+         CPPUNIT_ASSERT(rowSolidAngles.front() == 0);
+         CPPUNIT_ASSERT(rowSolidAngles.back() == 0);
+      }
+
+      std::vector<double> solidAngles;
+      image.getSolidAngles(solidAngles);
+      CPPUNIT_ASSERT(solidAngles.size() == nx*ny);
+      for (size_t k(0); k < solidAngles.size(); k++) {
+         CPPUNIT_ASSERT(solidAngles[k] == rowSolidAngles[k/nx]);
+      }
+   }
+
+// With the equator off the reference row, latitude is not linear
+// in the pixel ordinate.
+   std::vector<long> naxes;
+   naxes.push_back(nx);
+   naxes.push_back(18);
+   fitsfile * fptr(createImage(filename, -32, naxes,
+                               std::vector<double>(nx*18, 1.)));
+   writeWcs(fptr, "CAR", 18.5, 9.5, -10, 1, 0, 30);
+   closeFits(fptr);
+   std::vector<double> rowSolidAngles;
+   CPPUNIT_ASSERT(!FitsImage(filename).getRowSolidAngles(rowSolidAngles));
+   std::remove(filename.c_str());
+}
+
 void st_facilitiesTests::test_Env_appendNames() {
    std::string tmp_str;
    std::string::size_type pos;
@@ -10,6 +10,8 @@
 
 #include <vector>
 
+#include "st_facilities/BinLocator.h"
+
 namespace st_facilities {
 
 /**  
@@ -30,6 +32,16 @@ public:
 
    double operator()(double x, double y) const;
 
+   /// @brief Evaluate the interpolant at n points without any heap
+   /// allocation.  Results are identical to calling operator() on
+   /// each (x[k], y[k]) pair.
+   /// @param x Array of n abscissa values
+   /// @param y Array of n ordinate values
+   /// @param out Array of n values to be filled
+   /// @param n Number of points
+   void evaluate(const double * x, const double * y, double * out,
+                 size_t n) const;
+
 //    void getCorners(double x, double y, 
 //                    double & tt, double & uu,
 //                    std::vector<double> & corner_xvals,
@@ -57,6 +69,15 @@ private:
    std::vector<double> m_x;
    std::vector<double> m_y;
    std::vector<double> m_values;
+
+   BinLocator m_xlocator;
+   BinLocator m_ylocator;
+
+   /// Find the upper grid indices of the cell containing (x, y).
+   void getIndices(double x, double y, size_t & i, size_t & j) const;
+
+   /// Evaluate at a single point using only stack storage.
+   double value(double x, double y) const;
    
 };
 
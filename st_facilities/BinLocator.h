@@ -0,0 +1,96 @@
+/**
+ * @file BinLocator.h
+ * @brief Bin lookup on a sorted grid with O(1) index computation for
+ * uniformly and log-uniformly spaced grids.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_BinLocator_h
+#define st_facilities_BinLocator_h
+
+#include <vector>
+
+namespace st_facilities {
+
+/**
+ * @class BinLocator
+ *
+ * @brief Finds the bin containing a value in an ascending grid.  At
+ * construction the grid spacing is examined; if it is uniform in x or
+ * in log(x), to within a tolerance, the bin index is computed
+ * arithmetically and then corrected against the stored grid values,
+ * so the result is always identical to that of std::upper_bound.
+ * Irregular grids fall back to a binary search.
+ *
+ * Grids with one irregular node at either end, such as the padded
+ * grids used by Bilinear, are also handled: uniformity is then
+ * checked on the interior nodes.
+ */
+
+class BinLocator {
+
+public:
+
+   BinLocator();
+
+   /// @param grid Grid values in ascending order.
+   BinLocator(const std::vector<double> & grid);
+
+   /// @return The index of the first grid value greater than x, or
+   /// grid().size() if there is none, i.e., the same value as
+   /// std::upper_bound(grid.begin(), grid.end(), x) - grid.begin().
+   size_t upperBound(double x) const;
+
+   /// @return true if the bin index is computed from x arithmetically.
+   bool isUniform() const {
+      return m_spacing != IRREGULAR;
+   }
+
+   /// @return true if the grid is uniformly spaced in log(x).
+   bool isLogUniform() const {
+      return m_spacing == LOG_UNIFORM;
+   }
+
+   const std::vector<double> & grid() const {
+      return m_grid;
+   }
+
+   /// Parameters of the uniformly spaced section of the grid, for
+   /// use by vectorized code: the index of its first node, the number
+   /// of steps, and the origin and inverse step in x (or log(x)).
+   void getSpacing(size_t & first, size_t & nsteps,
+                   double & origin, double & invStep) const {
+      first = m_first;
+      nsteps = m_nsteps;
+      origin = m_origin;
+      invStep = m_invStep;
+   }
+
+private:
+
+   enum Spacing {IRREGULAR, UNIFORM, LOG_UNIFORM};
+
+   std::vector<double> m_grid;
+
+   Spacing m_spacing;
+
+   /// Index of the first node of the uniformly spaced section.
+   size_t m_first;
+
+   /// Number of intervals in the uniformly spaced section.
+   size_t m_nsteps;
+
+   /// Value (or log value) at m_first.
+   double m_origin;
+
+   /// Inverse of the grid step in x (or log(x)).
+   double m_invStep;
+
+   bool checkSpacing(size_t first, size_t last, bool logScale);
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_BinLocator_h
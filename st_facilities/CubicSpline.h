@@ -0,0 +1,92 @@
+/**
+ * @file CubicSpline.h
+ * @brief Piecewise cubic interpolation in one dimension with
+ * precomputed coefficients.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_CubicSpline_h
+#define st_facilities_CubicSpline_h
+
+#include <vector>
+
+namespace st_facilities {
+
+/**
+ * @class CubicSpline
+ *
+ * @brief Cubic interpolator whose polynomial coefficients for each
+ * interval are computed at construction, so an evaluation is a bracket
+ * search plus a Horner step.  Two methods are available:
+ *
+ * NATURAL: the C2 cubic spline with zero second derivative at the
+ * end points.
+ *
+ * MONOTONE: the C1 interpolant of Steffen (1990, A&A, 239, 443), whose
+ * slopes are limited so that it is monotonic wherever the data are
+ * and has no extrema other than at the nodes.  It is suited to
+ * tabulated response curves, where the overshoots of a spline would
+ * be unphysical.
+ *
+ * As for Interpolator1D, the bracketing interval of each call is
+ * remembered and used as the starting point of the next search, so
+ * an instance must not be shared between threads.
+ */
+
+class CubicSpline {
+
+public:
+
+   enum Method {NATURAL, MONOTONE};
+
+   /// @param x Abscissa values in strictly ascending order; at least two.
+   /// @param y Ordinate values; must be the same size as x.
+   /// @param method Interpolation method
+   CubicSpline(const std::vector<double> & x,
+               const std::vector<double> & y,
+               Method method=NATURAL);
+
+   /// @return The interpolated value at xx.  A std::range_error is
+   ///         thrown if xx is outside [x.front(), x.back()].
+   double operator()(double xx);
+
+   /// @brief Evaluate at n points.  Results are identical to calling
+   ///        operator() on each value in turn.
+   void evaluate(const double * xx, double * yy, size_t n);
+
+   /// @brief Evaluate at each of the values in xx.
+   /// @param yy On return, the interpolated values
+   void evaluate(const std::vector<double> & xx, std::vector<double> & yy);
+
+   Method method() const {
+      return m_method;
+   }
+
+   const std::vector<double> & x() const {
+      return m_x;
+   }
+
+private:
+
+   std::vector<double> m_x;
+
+   /// Polynomial coefficients of interval i, in powers of (xx - x[i]),
+   /// stored contiguously as m_coeffs[4*i], ..., m_coeffs[4*i + 3].
+   std::vector<double> m_coeffs;
+
+   double m_ylast;
+
+   Method m_method;
+
+   /// Lower index of the most recently used interval.
+   size_t m_index;
+
+   void computeSlopes(const std::vector<double> & y,
+                      std::vector<double> & slopes) const;
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_CubicSpline_h
@@ -10,9 +10,12 @@
 #ifndef st_facilities_FitsImage_h
 #define st_facilities_FitsImage_h
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "st_facilities/ImageView.h"
+
 namespace astro {
    class SkyDir;
    class SkyProj;
@@ -39,10 +42,20 @@ class FitsImage {
     
 public:
 
-   FitsImage() {}
+   /// How the pixel values are accessed.  READ copies the image into
+   /// memory.  MEMORY_MAP maps the image HDU of an uncompressed FITS
+   /// file into memory, so that only the pixels actually used are read
+   /// from disk and converted; images that cannot be mapped are read
+   /// instead.  ON_DEMAND reads nothing up front; each image plane is
+   /// read when requested via plane(k) and held in a cache of bounded
+   /// size.
+   enum LoadMode {READ, MEMORY_MAP, ON_DEMAND};
+
+   FitsImage() : m_mode(READ), m_hasProjection(false) {}
 
    FitsImage(const std::string & fitsfile, 
-             const std::string & extension="");
+             const std::string & extension="",
+             LoadMode mode=READ);
 
    FitsImage(const FitsImage &);
 
@@ -64,19 +77,65 @@ public:
    /// Get the pixel values.  They will be indexed by column, row,
    /// then plane, i.e., indx = i + j*NAXIS1 + k*NAXIS1*NAXIS2.  Note
    /// that each image plane is indexed starting at the lower left
-   /// (South-East) corner.
+   /// (South-East) corner.  In every load mode, the values are those
+   /// given by cfitsio when reading the image as floats, with pixels
+   /// of integer images equal to BLANK set to NaN.
    virtual void getImageData(std::vector<double> & imageData) const;
 
    /// This returns the pixel solid angles.  Use of this method assumes
    /// that m_axis[0] represents a longitudinal coordinate and that
    /// m_axis[1] represents a latitudinal coordinate.  The pixel values
-   /// will be indexed by column then row, indx = i + j*NAXIS1.
+   /// will be indexed by column then row, indx = i + j*NAXIS1.  The
+   /// calculation uses only the calling thread.
    virtual void getSolidAngles(std::vector<double> & solidAngles) const;
 
+   /// As above, with the rows of the image divided among nthreads
+   /// threads; nthreads = 0 uses all hardware threads.  Each pixel
+   /// corner is projected only once, and the results do not depend
+   /// on nthreads.
+   void getSolidAngles(std::vector<double> & solidAngles,
+                       size_t nthreads) const;
+
+   /// For maps in the CAR or CEA projections with the equator along a
+   /// pixel row and no rotation (CRVAL2 = CROTA2 = 0), pixel solid
+   /// angles depend only on the row.  In that case this returns the
+   /// exact solid angle of the pixels in each row, indexed by row, and
+   /// getSolidAngles returns these values expanded to all pixels.
+   /// @return false if the map is not of this kind.
+   bool getRowSolidAngles(std::vector<double> & rowSolidAngles) const;
+
+   /// The pixel values as read into memory.  This is empty if the
+   /// image is memory-mapped; use imageView() in that case.
    const std::vector<float> & imageData() const {
       return m_image;
    }
 
+   /// A view of the pixel values, indexed as for getImageData, in
+   /// either load mode.  Individual planes can be obtained using
+   /// ImageView::subView.  For READ mode, the view refers to
+   /// imageData() and is valid only while this object is unchanged.
+   ImageView imageView() const;
+
+   LoadMode loadMode() const {
+      return m_mode;
+   }
+
+   /// The number of image planes, i.e., NAXIS3 for a cube, or 1.
+   size_t numPlanes() const;
+
+   /// A view of image plane k, indexed by column then row.  In
+   /// ON_DEMAND mode, the plane is read from the file unless it is in
+   /// the plane cache.  This method may be called from several
+   /// threads; if cfitsio was built without reentrancy support, the
+   /// reads from the file are serialized.
+   ImageView plane(size_t k) const;
+
+   /// Set the maximum number of planes held in the ON_DEMAND plane
+   /// cache.  Views returned by plane(k) remain valid after their
+   /// plane has been dropped from the cache.  Each FitsImage has its
+   /// own cache: a copy starts with an empty cache of the same size.
+   void setPlaneCacheSize(size_t nplanes);
+
    /// @brief Factory method to create an astro::SkyProj object.
    /// @param fitsFile FITS file containing the WCS projection information.
    /// @param extension The name of the relevent FITS image extension.
@@ -109,6 +168,31 @@ protected:
       bool logScale;
    };
 
+/** 
+ * @class WcsParams
+ * @brief The header keywords defining a sky projection, kept so that
+ * independent astro::SkyProj objects, e.g., one per thread, can be
+ * created without reading the file again.
+ */
+   class WcsParams {
+   public:
+      WcsParams() : crota2(0), galactic(false) {}
+      /// Read the keywords; a std::runtime_error is thrown if CTYPE1
+      /// is not a recognized celestial coordinate.
+      void read(const tip::Header & header, const std::string & hduName);
+      astro::SkyProj * create() const;
+      /// @return true for the CAR and CEA projections in their
+      /// normal aspect, for which latitude depends only on the pixel
+      /// row and longitude is linear in the pixel column.
+      bool isRegularCylindrical() const;
+      std::string trans;
+      double crpix[2];
+      double crval[2];
+      double cdelt[2];
+      double crota2;
+      bool galactic;
+   };
+
    void read_fits_image();
 
    /// FITS file name.
@@ -123,8 +207,50 @@ protected:
    /// The FITS image data
    std::vector<float> m_image;
 
+   LoadMode m_mode;
+
+   /// The mapped image data, if the image is memory-mapped.
+   ImageView m_mappedImage;
+
+   /// Planes read in ON_DEMAND mode, defined in FitsImage.cxx.
+   class PlaneCache;
+
+   std::shared_ptr<PlaneCache> m_planeCache;
+
+   /// @return An empty cache of the same size as cache, if any.
+   static std::shared_ptr<PlaneCache>
+   copyPlaneCache(const std::shared_ptr<PlaneCache> & cache);
+
+   /// Read planes [first, first + nplanes) from the file.
+   std::shared_ptr<const std::vector<float> >
+   readPlanes(size_t first, size_t nplanes) const;
+
+   /// Read planes [first, first + nplanes) from the file into data.
+   void readPixels(size_t first, size_t nplanes, float * data) const;
+
+   /// The keywords of the WCS projection, read from the image header
+   /// in read_fits_image.  astro::SkyProj is not thread-safe, so each
+   /// method, or each thread, creates its own projection from these.
+   WcsParams m_wcs;
+
+   /// Whether m_wcs defines a valid projection.
+   bool m_hasProjection;
+
+   /// Why the header does not define a projection, if it does not.
+   std::string m_projError;
+
+   /// Read m_wcs from the image header.  If the header does not
+   /// describe a sky projection, m_hasProjection is false and the
+   /// reason is saved in m_projError.
    void setProjection(const tip::Header & header);
 
+   /// Throw a std::runtime_error if there is no projection.
+   void checkProjection() const;
+
+   /// Directions of the nx + 1 pixel corners at pixel ordinate y.
+   static void getCornerRow(const astro::SkyProj & proj, size_t nx,
+                            double y, std::vector<astro::SkyDir> & row);
+
 };
 
 } // namespace st_facilities
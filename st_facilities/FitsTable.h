@@ -13,6 +13,8 @@
 #define st_facilities_FitsTable_h
 
 #include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace tip {
@@ -21,7 +23,21 @@ namespace tip {
 
 namespace st_facilities {
 
-class Bilinear;
+/**
+ * @class FitsTable
+ *
+ * @brief Tabulated IRF data read from a FITS binary table.  The table
+ * data are immutable and reference-counted: copies share them, so
+ * worker threads can each hold a copy without duplicating the table,
+ * and the const methods take no locks.  setPar copies the data first
+ * if they are shared with another FitsTable.
+ *
+ * Tables read from files are also held in a process-wide cache keyed
+ * by (filename, extname, tablename, nrow), so that constructing
+ * another FitsTable for the same table shares the data already read
+ * instead of reading the file again.  A cached table is used only if
+ * the file's modification time, size and inode are unchanged.
+ */
 
 class FitsTable {
 
@@ -45,19 +61,31 @@ public:
    /// interpolation. Otherwise, return value for given cell.
    double value(double logenergy, double costh, bool interpolate=true) const;
     
-   double maximum() const {
-      return m_maxValue;
-   }
+   double maximum() const;
    
-   double minCosTheta() const {
-      return m_minCosTheta;
-   }
+   double minCosTheta() const;
 
    static void getVectorData(const tip::Table * table,
                              const std::string & fieldName,
                              std::vector<double> & values,
                              size_t nrow=0);
 
+   /// @brief Read the vector-valued cells of several columns from one
+   ///        row of a FITS table, opening the file and moving to the
+   ///        extension only once.  The cells are read by cfitsio
+   ///        directly into the output vectors, so that, unlike the
+   ///        tip-based version, double precision columns are not
+   ///        rounded to float.
+   /// @param fieldNames Names of the columns to read
+   /// @param values On return, values[i] holds the cell of column
+   ///        fieldNames[i].
+   /// @param nrow Zero-based row number
+   static void getVectorData(const std::string & filename,
+                             const std::string & extname,
+                             const std::vector<std::string> & fieldNames,
+                             std::vector< std::vector<double> > & values,
+                             size_t nrow=0);
+
    void getValues(std::vector<double> & values) const;
 
    void getCornerPars(double logE, double costh, 
@@ -65,27 +93,33 @@ public:
                       std::vector<double> & cornerEnergies,
                       std::vector<double> & cornerPars) const;
 
-   const std::vector<double> & logEnergies() const {
-      return m_logEnergies;
-   }
+   const std::vector<double> & logEnergies() const;
 
-   const std::vector<double> & costhetas() const {
-      return m_mus;
-   }
+   const std::vector<double> & costhetas() const;
 
    // bounds in log10(E)
-   const std::vector<double> & ebounds() const {
-      return m_ebounds;
-   }
+   const std::vector<double> & ebounds() const;
 
    // bounds in cos(theta)
-   const std::vector<double> & tbounds() const {
-      return m_tbounds;
-   }
+   const std::vector<double> & tbounds() const;
 
    double getPar(size_t ilogE, size_t icosth) const;
 
    void setPar(size_t ilogE, size_t icosth, double par);
+
+   /// @brief Set the memory budget, in bytes, of the table cache.
+   ///        The least recently used tables are dropped when it is
+   ///        exceeded.  A budget of zero disables caching.  Cached
+   ///        tables are keyed by the canonical path of the file and
+   ///        are re-read if its modification time, size or inode
+   ///        changes.  On file systems whose timestamps are coarser
+   ///        than the interval between rewrites of a file of the same
+   ///        size in place, call clearCache() after rewriting it.
+   static void setCacheBudget(size_t bytes);
+
+   /// @brief Drop all tables from the cache.  FitsTable objects
+   ///        holding them are unaffected.
+   static void clearCache();
    
 protected:
 
@@ -96,18 +130,22 @@ protected:
 
 private:
 
-   Bilinear * m_interpolator;
+   /// The table contents, defined in FitsTable.cxx.
+   struct Data;
 
-   std::vector<double> m_logEnergies; 
-   std::vector<double> m_mus; 
-   std::vector<double> m_values;
+   std::shared_ptr<Data> m_data;
 
-   std::vector<double> m_ebounds;
-   std::vector<double> m_tbounds;
-   
-   double m_minCosTheta;
+   /// The process-wide table cache, defined in FitsTable.cxx.
+   class Cache;
+
+   static void readData(const std::string & filename,
+                        const std::string & extname,
+                        const std::string & tablename,
+                        size_t nrow, Data & data);
 
-   double m_maxValue;
+   /// @return The table contents for modification, after making a
+   ///         private copy if they are shared.
+   Data & mutableData();
 
 };
 
@@ -9,7 +9,9 @@
 #ifndef st_facilities_FitsUtil_h
 #define st_facilities_FitsUtil_h
 
+#include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace st_facilities {
@@ -24,19 +26,124 @@ class FitsUtil {
 
 public:
 
+   /// Ranges of table rows, each given by the zero-based index of its
+   /// first row and the index one past its last row.
+   typedef std::vector< std::pair<size_t, size_t> > RowRanges;
+
+   /// Function called for each block of rows read by readColumnChunks,
+   /// with the zero-based index of the first row, the number of rows,
+   /// the number of elements per row, and the nrows*repeat values.
+   typedef std::function<void(size_t firstRow, size_t nrows, size_t repeat,
+                              const double * values)> ColumnChunkCallback;
+
    /// Get a vector of values from the specified extension and column.
+   /// The column is read with cfitsio in blocks of rows of the optimal
+   /// size for its buffers.  For vector columns, the repeat elements
+   /// of each row are stored consecutively.
+   static void getTableVector(const std::string & filename,
+                              const std::string & extName,
+                              const std::string & columnName,
+                              std::vector<double> & branchVector);
+
+   /// @brief Get the values of a column for the given rows only.  The
+   ///        values for each range are stored consecutively, in the
+   ///        order of the ranges.
    static void getTableVector(const std::string & filename,
                               const std::string & extName,
                               const std::string & columnName,
+                              const RowRanges & rows,
                               std::vector<double> & branchVector);
 
-   /// Get a vector from a given row of a record.
+   /// @brief Find the rows of a table that satisfy a cfitsio row
+   ///        filter expression, e.g., "ENERGY > 100 && ZENITH_ANGLE < 105",
+   ///        using fits_find_rows.
+   /// @param rows On return, the sorted ranges of the selected rows
+   static void findRows(const std::string & filename,
+                        const std::string & extName,
+                        const std::string & filterString,
+                        RowRanges & rows);
+
+   /// @brief Find the rows of a table whose values in a column sorted
+   ///        in ascending order, such as TIME, lie within any of the
+   ///        closed intervals [start, stop].  Only O(log(nrows)) values
+   ///        are read for each interval.
+   /// @param rows On return, the sorted, non-overlapping ranges of the
+   ///        selected rows
+   static void findSortedRows(const std::string & filename,
+                              const std::string & extName,
+                              const std::string & columnName,
+                              const std::vector< std::pair<double, double> >
+                              & intervals,
+                              RowRanges & rows);
+
+   /// @brief Read a column in blocks of rows and pass each block to
+   ///        callback, so that the column need not be held in memory
+   ///        at once.  Variable length array columns are not supported.
+   /// @param chunkRows Number of rows per block; if zero, the number
+   ///        given by fits_get_rowsize is used.
+   static void readColumnChunks(const std::string & filename,
+                                const std::string & extName,
+                                const std::string & columnName,
+                                const ColumnChunkCallback & callback,
+                                size_t chunkRows=0);
+
+   /// @brief Read several columns of a binary table extension with a
+   ///        single sequential sweep through the table.  Blocks of
+   ///        rows are read as raw bytes and the numeric columns are
+   ///        decoded, including TSCALn and TZEROn, on up to nthreads
+   ///        threads; other fixed-length columns are read with
+   ///        fits_read_col.
+   /// @param columns On return, columns[k] holds the values of
+   ///        columnNames[k], as for getTableVector.
+   /// @param nthreads Maximum number of decoding threads; zero selects
+   ///        the number of hardware threads.
+   static void getTableColumns(const std::string & filename,
+                               const std::string & extName,
+                               const std::vector<std::string> & columnNames,
+                               std::vector< std::vector<double> > & columns,
+                               size_t nthreads=1);
+
+   /// @brief Read several columns, as above, and get the number of
+   ///        elements per row of each.
+   /// @param repeats On return, repeats[k] holds the number of
+   ///        elements per row of columnNames[k], so that columns[k]
+   ///        holds repeats[k] values for each row.
+   static void getTableColumns(const std::string & filename,
+                               const std::string & extName,
+                               const std::vector<std::string> & columnNames,
+                               std::vector< std::vector<double> > & columns,
+                               std::vector<size_t> & repeats,
+                               size_t nthreads=1);
+
+   /// @brief Read several columns, as above, for the given rows only.
+   ///        The values for each range are stored consecutively, in the
+   ///        order of the ranges.
+   static void getTableColumns(const std::string & filename,
+                               const std::string & extName,
+                               const std::vector<std::string> & columnNames,
+                               const RowRanges & rows,
+                               std::vector< std::vector<double> > & columns,
+                               size_t nthreads=1);
+
+   /// Get a vector from a given row of a record.  The row is read
+   /// directly, without reading the rows that precede it.
    static void getRecordVector(const std::string & filename,
                                const std::string & extName,
                                const std::string & columnName,
                                std::vector<double> & tableVector,
                                int recordNum = 0);
 
+   /// @brief Get the vectors from several rows of a record, opening
+   ///        the file once.  tableVectors[i] holds the cell of the
+   ///        zero-based row recordNums[i].  Variable length array
+   ///        columns are supported.
+   static void getRecordVectors(const std::string & filename,
+                                const std::string & extName,
+                                const std::string & columnName,
+                                const std::vector<size_t> & recordNums,
+                                std::vector< std::vector<double> > 
+                                & tableVectors);
+
    /// Get the extension name of a FITS table HDU by extension number.
    static void getFitsHduName(const std::string & filename, int hdu,
                               std::string & hduName);
@@ -45,8 +152,27 @@ public:
    static void getFitsColNames(const std::string & filename, int hdu,
                                std::vector<std::string> & columnNames);
 
-   /// Write checksum and datasum information for all HDUs in a FITS file.
-   static void writeChecksums(const std::string & filename);
+   /// @brief Write checksum and datasum information for all HDUs in a
+   ///        FITS file, and the FILENAME keyword to the primary header,
+   ///        opening the file once.  For plain (uncompressed) files, the
+   ///        data checksums are computed directly from the file on up
+   ///        to nthreads threads; zero selects the number of hardware
+   ///        threads.
+   static void writeChecksums(const std::string & filename,
+                              size_t nthreads=0);
+
+   /// @brief Update DATASUM and CHECKSUM of a binary table extension
+   ///        after rows have been appended to it, reading only the new
+   ///        rows.  The existing DATASUM must be that of the table as it
+   ///        was before rows were appended.  If the table has a heap,
+   ///        lacks a DATASUM keyword, or the file is compressed, the
+   ///        checksums are computed from all of the data instead.
+   ///        Checksums of other HDUs are not affected by appending rows.
+   /// @param firstNewRow Zero-based index of the first appended row,
+   ///        i.e., the number of rows before the append
+   static void updateChecksums(const std::string & filename,
+                               const std::string & extName,
+                               size_t firstNewRow, size_t nthreads=0);
 
    /// Write FILENAME keyword to primary header
    static void writeFilename(const std::string & filename);
@@ -58,6 +184,33 @@ public:
                      const std::string & filterString="",
                      bool clobber=false);
 
+   /// Function called by filterCopy after each block of rows, with the
+   /// number of input rows processed so far, the total number of input
+   /// rows, and the average rate in rows per second.
+   typedef std::function<void(size_t rowsDone, size_t totalRows,
+                              double rowsPerSecond)> ProgressCallback;
+
+   /// @brief Copy a FITS file, keeping only the rows of the binary
+   ///        table extension extname that satisfy the cfitsio row
+   ///        filter expression filterString; the result is that of
+   ///        fcopy.  The table is streamed in blocks of rows, each
+   ///        read from the file once: the filter is evaluated for each
+   ///        block on up to nthreads threads (zero selects the number
+   ///        of hardware threads; one is used unless cfitsio is
+   ///        reentrant), on in-memory copies of the rows, and the
+   ///        selected rows are written in order.  Tables with variable
+   ///        length array columns, other HDU types, filters that refer
+   ///        to row numbers (#ROW) or to the GTI extension of the input
+   ///        file (gtifilter() with no file name), and an empty extname
+   ///        or filterString are copied with fcopy instead.
+   static void filterCopy(const std::string & infilename,
+                          const std::string & outfilename,
+                          const std::string & extname,
+                          const std::string & filterString,
+                          bool clobber=false,
+                          const ProgressCallback & progress=ProgressCallback(),
+                          size_t nthreads=0);
+
 protected:
 
    FitsUtil() {}
@@ -0,0 +1,129 @@
+/**
+ * @file ImageView.h
+ * @brief Read-only view of FITS image pixels that decodes values on
+ * access.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_ImageView_h
+#define st_facilities_ImageView_h
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace st_facilities {
+
+/**
+ * @class ImageView
+ *
+ * @brief A strided sequence of pixels of a FITS image.  The pixels
+ * are either those of an image HDU mapped into memory directly from
+ * the file, in which case they are in FITS (big-endian) format and
+ * are converted only when accessed; or those of an image already read
+ * into memory as floats.  Mapped pixels are converted as cfitsio
+ * converts them when reading the image as floats: BSCALE and BZERO
+ * are applied, the result is rounded to float, and pixels of integer
+ * images equal to BLANK are NaN.  The values are therefore the same
+ * as those of the image read into memory with a NaN null value.
+ *
+ * Views of a mapped file share the mapping, which is released when
+ * the last view referring to it is destroyed.  Views of in-memory
+ * data share ownership of the data if constructed from a shared_ptr
+ * and otherwise do not own them.
+ */
+
+class ImageView {
+
+public:
+
+   ImageView();
+
+   /// @brief View of pixels already in memory.
+   /// @param data Pixel values, which must outlive the view
+   /// @param size Number of pixels
+   ImageView(const float * data, size_t size);
+
+   /// @brief View of pixels in memory, which the view keeps alive.
+   ImageView(const std::shared_ptr<const std::vector<float> > & data);
+
+   /// @brief Map an image HDU of a FITS file into memory.
+   /// @param filename FITS file name
+   /// @param extension Name or number of the image extension; if
+   ///        empty, the primary HDU is used.
+   /// @param view On success, a view of all of the pixels of the HDU
+   /// @return false if the HDU cannot be mapped, e.g., because the
+   ///         file is compressed or the image is tile-compressed, in
+   ///         which case it must be read instead.  cfitsio errors in
+   ///         locating the HDU result in a std::runtime_error.
+   static bool mapFits(const std::string & filename,
+                       const std::string & extension,
+                       ImageView & view);
+
+   /// @return The pixel value at position indx in the view.
+   double operator[](size_t indx) const;
+
+   /// @brief Convert n pixels, starting at position first.
+   void get(size_t first, size_t n, double * values) const;
+
+   /// @brief Convert all pixels of the view.
+   void get(std::vector<double> & values) const;
+
+   /// @return A view of count pixels starting at position first of
+   ///         this view and taking every stride-th pixel thereafter.
+   ImageView subView(size_t first, size_t count, size_t stride=1) const;
+
+   size_t size() const {
+      return m_size;
+   }
+
+   bool empty() const {
+      return m_size == 0;
+   }
+
+   /// @return true if the pixels are read directly from a mapped file.
+   bool isMapped() const {
+      return !m_native;
+   }
+
+private:
+
+   /// Keeps the mapped file or the in-memory data alive, if the view
+   /// shares ownership of them.
+   std::shared_ptr<const void> m_owner;
+
+   /// First byte of the first pixel in the view.
+   const unsigned char * m_data;
+
+   size_t m_size;
+
+   /// Distance between consecutive pixels of the view, in pixels.
+   size_t m_stride;
+
+   /// FITS BITPIX value of the stored pixels; in-memory float data are
+   /// flagged by m_native.
+   int m_bitpix;
+
+   bool m_native;
+
+   double m_bscale;
+
+   double m_bzero;
+
+   /// Whether an integer image has a BLANK value, and the value.
+   bool m_hasBlank;
+
+   long long m_blank;
+
+   size_t bytesPerPixel() const {
+      return m_native ? sizeof(float) : (m_bitpix < 0 ? -m_bitpix : m_bitpix)/8;
+   }
+
+   double decode(const unsigned char * pixel) const;
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_ImageView_h
@@ -0,0 +1,86 @@
+/**
+ * @file Interpolator1D.h
+ * @brief Linear interpolation in one dimension with a bracket that
+ * is remembered between calls.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_Interpolator1D_h
+#define st_facilities_Interpolator1D_h
+
+#include <vector>
+
+namespace st_facilities {
+
+/**
+ * @class Interpolator1D
+ *
+ * @brief Linear interpolator giving the same results as
+ * Util::interpolate.  The bracketing interval found for each call is
+ * remembered, and the next search starts from it, stepping outwards
+ * in increasing strides ("hunting") before bisecting.  Sequences of
+ * nearby or monotonic abscissa values, such as the energies of a
+ * spectral integration, therefore cost O(1) per call instead of a
+ * binary search over the full grid.
+ *
+ * Because operator() updates the remembered bracket, an instance
+ * must not be shared between threads.
+ */
+
+class Interpolator1D {
+
+public:
+
+   /// @param x Abscissa values in ascending order; at least two.
+   /// @param y Ordinate values; must be the same size as x.
+   Interpolator1D(const std::vector<double> & x,
+                  const std::vector<double> & y);
+
+   /// @return The interpolated value at xx.  A std::range_error is
+   ///         thrown if xx is outside [x.front(), x.back()].
+   double operator()(double xx);
+
+   const std::vector<double> & x() const {
+      return m_x;
+   }
+
+   const std::vector<double> & y() const {
+      return m_y;
+   }
+
+   /// @brief Find the bracketing interval of xx, starting from a guess.
+   /// @param x Abscissa values in ascending order
+   /// @param xx Value satisfying x.front() <= xx < x.back()
+   /// @param guess Index of a previous bracket; any value is allowed.
+   /// @return The index i of the last x[i] <= xx, i.e., the value of
+   ///         std::upper_bound(x.begin(), x.end(), xx) - x.begin() - 1.
+   static size_t hunt(const std::vector<double> & x, double xx,
+                      size_t guess);
+
+   /// @brief Interpolate linearly within the interval [x[i], x[i+1]].
+   /// If the interval has zero width, the mean of y[i] and y[i+1] is
+   /// returned.  This is the formula shared by operator() and
+   /// Util::interpolate.
+   static double interpolate(const std::vector<double> & x,
+                             const std::vector<double> & y,
+                             size_t i, double xx) {
+      if (x[i+1] != x[i]) {
+         return (xx - x[i])/(x[i+1] - x[i])*(y[i+1] - y[i]) + y[i];
+      }
+      return (y[i+1] + y[i])/2.;
+   }
+
+private:
+
+   std::vector<double> m_x;
+   std::vector<double> m_y;
+
+   /// Lower index of the most recently used interval.
+   size_t m_index;
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_Interpolator1D_h
@@ -0,0 +1,91 @@
+/**
+ * @file MatrixView.h
+ * @brief Non-owning view of a two-dimensional table held in
+ * contiguous, row-major storage.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_MatrixView_h
+#define st_facilities_MatrixView_h
+
+#include <stdexcept>
+#include <vector>
+
+namespace st_facilities {
+
+/**
+ * @class MatrixView
+ *
+ * @brief Read-only, row-major view of an nrows x ncols table.  The
+ * view does not own the data, which must outlive it.  Element (i, j)
+ * is data[i*ncols + j], so a row is a contiguous block.
+ */
+
+class MatrixView {
+
+public:
+
+   MatrixView(const double * data, size_t nrows, size_t ncols)
+      : m_data(data), m_nrows(nrows), m_ncols(ncols) {}
+
+   MatrixView(const std::vector<double> & data, size_t nrows, size_t ncols)
+      : m_data(data.empty() ? 0 : &data[0]), m_nrows(nrows), m_ncols(ncols) {
+      if (data.size() != nrows*ncols) {
+         throw std::invalid_argument("MatrixView: data size does not "
+                                     "equal nrows*ncols");
+      }
+   }
+
+   double operator()(size_t i, size_t j) const {
+      return m_data[i*m_ncols + j];
+   }
+
+   const double * row(size_t i) const {
+      return m_data + i*m_ncols;
+   }
+
+   const double * data() const {
+      return m_data;
+   }
+
+   size_t nrows() const {
+      return m_nrows;
+   }
+
+   size_t ncols() const {
+      return m_ncols;
+   }
+
+   /// @brief Copy a vector of vectors into row-major storage, so that
+   ///        tables can be converted once and viewed thereafter.
+   /// @param table Each element of table is one row; all rows must
+   ///        have the same length.
+   /// @param data On return, the flattened table.
+   /// @return A view of data.
+   static MatrixView flatten(const std::vector< std::vector<double> > & table,
+                             std::vector<double> & data) {
+      size_t ncols(table.empty() ? 0 : table.front().size());
+      data.clear();
+      data.reserve(table.size()*ncols);
+      for (size_t i(0); i < table.size(); i++) {
+         if (table[i].size() != ncols) {
+            throw std::invalid_argument("MatrixView::flatten: "
+                                        "rows have different lengths");
+         }
+         data.insert(data.end(), table[i].begin(), table[i].end());
+      }
+      return MatrixView(data, table.size(), ncols);
+   }
+
+private:
+
+   const double * m_data;
+   size_t m_nrows;
+   size_t m_ncols;
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_MatrixView_h
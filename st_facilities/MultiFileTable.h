@@ -0,0 +1,123 @@
+/**
+ * @file MultiFileTable.h
+ * @brief Reader for a table extension spread over a list of FITS
+ * files, such as weekly FT1 files.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_MultiFileTable_h
+#define st_facilities_MultiFileTable_h
+
+#include <future>
+#include <string>
+#include <vector>
+
+namespace st_facilities {
+
+/**
+ * @class MultiFileTable
+ *
+ * @brief Reads the same columns of a table extension from each file
+ * in a list, e.g., as returned by Util::resolve_fits_files or
+ * FileSys::expandFileList, as if the tables were one.  The columns
+ * are read with FitsUtil::getTableColumns, and while the tables of
+ * one file are returned to the caller, those of the next file are
+ * read on a background thread.
+ *
+ * The files are read in sequence either one at a time with next(),
+ * or all at once with readAll(), which concatenates the tables, or
+ * readMerged(), which merges them in order of a sort column such as
+ * TIME.  An instance must not be shared between threads.
+ */
+
+class MultiFileTable {
+
+public:
+
+   /// Column values, one vector per column, as for
+   /// FitsUtil::getTableColumns.
+   typedef std::vector< std::vector<double> > Columns;
+
+   /// @param files FITS file names
+   /// @param extName Name of the table extension in each file
+   /// @param columnNames Columns to read
+   /// @param nthreads Number of threads with which each file's columns
+   ///        are decoded; zero selects the number of hardware threads.
+   MultiFileTable(const std::vector<std::string> & files,
+                  const std::string & extName,
+                  const std::vector<std::string> & columnNames,
+                  size_t nthreads=1);
+
+   /// Waits for any background read to finish.
+   ~MultiFileTable();
+
+   /// @brief Get the columns of the next file and start reading the
+   ///        one after it.  Errors reading a file are thrown here,
+   ///        after which the caller may continue with the next file.
+   /// @return false if all of the files have been read.
+   bool next(Columns & columns);
+
+   /// @return The index in the file list of the file most recently
+   ///         returned by next().
+   size_t fileIndex() const {
+      return m_current;
+   }
+
+   /// @brief Concatenate the tables of the files not yet read, in the
+   ///        order of the file list.
+   void readAll(Columns & columns);
+
+   /// @brief Merge the rows of the tables of the files not yet read
+   ///        into ascending order of sortColumn, which must be one of
+   ///        the scalar columns being read.  Each column must have the
+   ///        same number of elements per row in every file.  A
+   ///        std::invalid_argument is thrown otherwise.  The rows of
+   ///        each file are usually already sorted, e.g., by TIME, in
+   ///        which case this is a k-way merge; otherwise they are
+   ///        sorted first.  Rows with equal values keep their file
+   ///        order.
+   void readMerged(const std::string & sortColumn, Columns & columns);
+
+   const std::vector<std::string> & files() const {
+      return m_files;
+   }
+
+private:
+
+   std::vector<std::string> m_files;
+
+   std::string m_extName;
+
+   std::vector<std::string> m_columnNames;
+
+   size_t m_nthreads;
+
+   /// Index of the file being read in the background.
+   size_t m_next;
+
+   size_t m_current;
+
+   /// The columns of one file and their elements per row.
+   struct Table {
+      Columns columns;
+      std::vector<size_t> repeats;
+   };
+
+   std::future<Table> m_prefetch;
+
+   /// Start reading file m_next in the background, if any remain.
+   void startPrefetch();
+
+   /// As for next(), but with the elements per row of each column.
+   bool nextTable(Table & table);
+
+   /// Disable copy and assignment.
+   MultiFileTable(const MultiFileTable &);
+   MultiFileTable & operator=(const MultiFileTable &);
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_MultiFileTable_h
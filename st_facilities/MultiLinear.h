@@ -0,0 +1,168 @@
+/**
+ * @file MultiLinear.h
+ * @brief Multilinear interpolation on an N-dimensional rectilinear grid.
+ *
+ * $Header$
+ */
+
+#ifndef st_facilities_MultiLinear_h
+#define st_facilities_MultiLinear_h
+
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "st_facilities/BinLocator.h"
+
+namespace st_facilities {
+
+/**
+ * @class MultiLinear
+ *
+ * @brief Multilinear interpolator over an N-dimensional table stored
+ * in a single contiguous array.  The first axis varies fastest, i.e.,
+ * the value at grid indices (i0, i1, ..., i(N-1)) is at
+ * i0 + n0*(i1 + n1*(i2 + ...)), which is the layout of Bilinear and
+ * of IRF tables read from FITS files.
+ *
+ * Points outside the grid are evaluated using the nearest edge cell,
+ * i.e., they are extrapolated linearly, as in Util::bilinear.
+ *
+ * Bin lookups use a BinLocator for each axis.  Callers that evaluate
+ * nearby points in sequence can pass a Cache so that the bracketing
+ * indices found for the previous point are checked first.
+ */
+
+template<size_t N>
+class MultiLinear {
+
+public:
+
+   /**
+    * @class Cache
+    * @brief The grid cell used for the previous point.  A Cache must
+    * not be shared between threads; the interpolator itself may be.
+    */
+   class Cache {
+   public:
+      Cache() {
+         for (size_t d(0); d < N; d++) {
+            index[d] = 0;
+         }
+      }
+   private:
+      friend class MultiLinear;
+      size_t index[N];
+   };
+
+   /// @param axes Grid values, in ascending order, for each of the
+   ///        N axes.  Each axis must have at least two nodes.
+   /// @param values The tabulated values, first axis fastest.
+   MultiLinear(const std::vector< std::vector<double> > & axes,
+               const std::vector<double> & values) : m_values(values) {
+      if (axes.size() != N) {
+         throw std::invalid_argument("MultiLinear: wrong number of axes");
+      }
+      size_t npts(1);
+      for (size_t d(0); d < N; d++) {
+         if (axes[d].size() < 2) {
+            std::ostringstream message;
+            message << "MultiLinear: axis " << d
+                    << " has fewer than two nodes";
+            throw std::invalid_argument(message.str());
+         }
+         m_locators[d] = BinLocator(axes[d]);
+         m_strides[d] = npts;
+         npts *= axes[d].size();
+      }
+      if (npts != m_values.size()) {
+         throw std::invalid_argument("MultiLinear: size of values array "
+                                     "does not match the axes");
+      }
+// Offsets of the 2^N cell corners relative to the lower corner.
+      for (size_t corner(0); corner < s_ncorners; corner++) {
+         m_cornerOffsets[corner] = 0;
+         for (size_t d(0); d < N; d++) {
+            if (corner & (size_t(1) << d)) {
+               m_cornerOffsets[corner] += m_strides[d];
+            }
+         }
+      }
+   }
+
+   /// @param point Array of N coordinates
+   double operator()(const double * point) const {
+      Cache cache;
+      return operator()(point, cache);
+   }
+
+   /// @param point Array of N coordinates
+   /// @param cache Grid cell of the previous point; updated on return.
+   double operator()(const double * point, Cache & cache) const {
+      double weights[N];
+      size_t offset(0);
+      for (size_t d(0); d < N; d++) {
+         const std::vector<double> & grid(m_locators[d].grid());
+         double x(point[d]);
+         size_t & indx(cache.index[d]);
+         if (!(indx > 0 && indx < grid.size()
+               && grid[indx-1] <= x && x < grid[indx])) {
+            indx = m_locators[d].upperBound(x);
+            if (indx < 1) {
+               indx = 1;
+            } else if (indx > grid.size() - 1) {
+               indx = grid.size() - 1;
+            }
+         }
+         weights[d] = (x - grid[indx-1])/(grid[indx] - grid[indx-1]);
+         offset += (indx - 1)*m_strides[d];
+      }
+      const double * values(&m_values[offset]);
+      double value(0);
+      for (size_t corner(0); corner < s_ncorners; corner++) {
+         double weight(1);
+         for (size_t d(0); d < N; d++) {
+            weight *= (corner & (size_t(1) << d)) ? weights[d]
+               : 1. - weights[d];
+         }
+         value += weight*values[m_cornerOffsets[corner]];
+      }
+      return value;
+   }
+
+   /// @brief Evaluate at npts points.
+   /// @param points Array of npts*N coordinates, with the N
+   ///        coordinates of each point stored contiguously.
+   /// @param out Array of npts values to be filled.
+   void evaluate(const double * points, double * out, size_t npts) const {
+      Cache cache;
+      for (size_t k(0); k < npts; k++) {
+         out[k] = operator()(points + k*N, cache);
+      }
+   }
+
+   const std::vector<double> & axis(size_t d) const {
+      return m_locators[d].grid();
+   }
+
+   const std::vector<double> & values() const {
+      return m_values;
+   }
+
+private:
+
+   static const size_t s_ncorners = size_t(1) << N;
+
+   BinLocator m_locators[N];
+
+   size_t m_strides[N];
+
+   size_t m_cornerOffsets[s_ncorners];
+
+   std::vector<double> m_values;
+
+};
+
+} // namespace st_facilities
+
+#endif // st_facilities_MultiLinear_h
@@ -28,6 +28,8 @@ namespace astro {
 
 namespace st_facilities {
 
+class MatrixView;
+
 /**
  * @class Util
  * @brief Various static functions of general use for Science Tools 
@@ -70,10 +72,21 @@ public:
    /// @param line The string to be cleaned.
    static void cleanLine(std::string & line);
 
-   /// @brief Test if infile is a FITS file by opening it with cfitsio
+   /// @brief Test if infile is a FITS file.  For plain files, only the
+   ///        first header block is read, and the result is remembered,
+   ///        under the canonical path of the file, until its
+   ///        modification time, size or inode changes.  Files
+   ///        with a compression signature, and names that are not those
+   ///        of regular files, e.g., cfitsio extended file names, are
+   ///        tested by opening them with cfitsio.
    /// @param infile Input file name
    static bool isFitsFile(const std::string & infile);
 
+   /// @brief Forget the results remembered by isFitsFile, e.g., if a
+   ///        file may have been rewritten in place with the same size
+   ///        within the resolution of its modification time.
+   static void clearFitsFileCache();
+
    /// @brief Determine if filename is a FITS file using isFitsFile.  If it is
    ///        not a FITS file, then it is assumed to be a list if FITS files.
    /// @param filename The name of the candidate file; enviroment 
@@ -92,6 +105,16 @@ public:
                              const std::vector<double> &y,
                              double xx);
 
+   /// @brief Linear interpolation at each of the values in xx, with
+   ///        the same results as the single-value version.  The search
+   ///        for each bracketing interval starts from the previous
+   ///        one, so for xx in sorted order the cost is O(n + m).
+   /// @param yy On return, the interpolated values
+   static void interpolate(const std::vector<double> &x,
+                           const std::vector<double> &y,
+                           const std::vector<double> &xx,
+                           std::vector<double> &yy);
+
    /// A bilinear interpolater.
    static double bilinear(const std::vector<double> &xx, double x,
                           const std::vector<double> &yy, double y, 
@@ -102,6 +125,14 @@ public:
                           const std::vector<double> &yy, double y, 
                           const std::vector< std::vector<double> > &z);
 
+   /// A bilinear interpolater operating on contiguous, row-major
+   /// storage, with z(i, j) the value at (xx[i], yy[j]).  Tables held
+   /// as a vector of vectors can be converted once with
+   /// MatrixView::flatten.
+   static double bilinear(const std::vector<double> &xx, double x,
+                          const std::vector<double> &yy, double y, 
+                          const MatrixView &z);
+
    /// @return true if eObj.what() contains the targetMessage
    ///         as a substring.
    static bool expectedException(const std::exception & eObj,
@@ -131,6 +162,35 @@ public:
    /// @brief Add pixel index to SkyDir interface to ProjBase
    static void pixel2SkyDir(const astro::ProjBase & proj, double i, double j,
                             astro::SkyDir & dir);
+
+   /// @brief Convert n sky coordinates to pixel indices.  No SkyDir
+   ///        objects are created.
+   /// @param lon, lat Coordinates (degrees) in the system of the
+   ///        projection, i.e., (l, b) if proj.isGalactic() and
+   ///        (ra, dec) otherwise
+   /// @param i, j Arrays of n pixel indices to be filled
+   static void skyDir2pixel(const astro::ProjBase & proj,
+                            const double * lon, const double * lat,
+                            double * i, double * j, size_t n);
+
+   /// @brief As above, with the points divided among projs.size()
+   ///        threads.  Projections are generally not thread-safe, so
+   ///        each thread uses its own; they must all be equivalent.
+   static void skyDir2pixel(const std::vector<const astro::ProjBase *> & projs,
+                            const double * lon, const double * lat,
+                            double * i, double * j, size_t n);
+
+   /// @brief Convert n pixel indices to sky coordinates in the system
+   ///        of the projection.  No SkyDir objects are created.
+   static void pixel2SkyDir(const astro::ProjBase & proj,
+                            const double * i, const double * j,
+                            double * lon, double * lat, size_t n);
+
+   /// @brief As above, with the points divided among projs.size()
+   ///        threads, each using its own projection.
+   static void pixel2SkyDir(const std::vector<const astro::ProjBase *> & projs,
+                            const double * i, const double * j,
+                            double * lon, double * lat, size_t n);
    
    /// @return The current time ascertained using the <ctime> standard
    /// library.
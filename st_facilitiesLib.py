@@ -8,6 +8,8 @@ def generate(env, **kw):
     env.Tool('addLibrary', library = env['cfitsioLibs'])
     env.Tool('addLibrary', library = env['f2cLibs'])
     env.Tool('addLibrary', library = env['cppunitLibs'])
+    if env['PLATFORM'] == 'posix':
+        env.Tool('addLibrary', library = ['pthread'])
     try:
         env.Tool('addLibrary', library = env['gsllibs'])
     except: